@@ -0,0 +1,324 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include <Bounds.h>
+#include <Frustum.h>
+
+// Bounding volume hierarchy over a set of boxes identified by their index.
+// The tree is built top-down (median split along the longest axis) when
+// items are added or removed; when boxes only move, refit() updates the
+// bounds of the nodes above them without changing the topology.
+class BVH {
+public:
+    // rebuild the tree over boxes; item i is boxes[i]
+    void build(const std::vector<AABB>& boxes)
+    {
+        _boxes = boxes;
+        _items.resize(_boxes.size());
+        for (size_t i = 0; i < _items.size(); ++i)
+            _items[i] = i;
+        _leaf.resize(_boxes.size());
+        _moved.clear();
+
+        _nodes.clear();
+        if (_boxes.empty())
+            return;
+
+        _nodes.reserve(2 * _boxes.size());
+        _nodes.push_back(Node());
+        _nodes[0].parent = 0;
+        _build(0, 0, _items.size());
+    }
+
+    size_t number_of_items()
+    { return _boxes.size(); }
+
+    const AABB& bounds(uint32_t item)
+    { return _boxes[item]; }
+
+    // move item (an empty box takes it out of every query); call refit()
+    // once all boxes are updated
+    void set_bounds(uint32_t item, const AABB& b)
+    {
+        _boxes[item] = b;
+        _moved.push_back(item);
+    }
+
+    // recompute the bounds of the nodes above the items moved since the
+    // last call, leaf to root; a path stops at the first node whose box
+    // does not change, so the cost grows with the moved items only
+    void refit()
+    {
+        for (size_t i = 0; i < _moved.size(); ++i) {
+            uint32_t n = _leaf[_moved[i]];
+            for (;;) {
+                Node& node = _nodes[n];
+                AABB box;
+                if (node.count > 0) {
+                    for (uint32_t k = 0; k < node.count; ++k)
+                        box.expand(_boxes[_items[node.first + k]]);
+                } else {
+                    box.expand(_nodes[node.first].box);
+                    box.expand(_nodes[node.first + 1].box);
+                }
+                if (box == node.box)
+                    break;
+                node.box = box;
+                if (n == 0)
+                    break;
+                n = node.parent;
+            }
+        }
+        _moved.clear();
+    }
+
+    // items whose box intersects the frustum
+    void query(const Frustum& frustum, std::vector<uint32_t>& result)
+    {
+        if (_nodes.empty())
+            return;
+
+        _stack.clear();
+        _stack.push_back(0);
+        while (!_stack.empty()) {
+            const Node& node = _nodes[_stack.back()];
+            _stack.pop_back();
+
+            Frustum::Classification c = frustum.classify(node.box);
+            if (c == Frustum::OUTSIDE)
+                continue;
+            if (c == Frustum::INSIDE) {
+                // whole subtree is visible, no more plane tests
+                _collect(node, result);
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    uint32_t item = _items[node.first + i];
+                    if (frustum.intersects(_boxes[item]))
+                        result.push_back(item);
+                }
+            } else {
+                _stack.push_back(node.first);
+                _stack.push_back(node.first + 1);
+            }
+        }
+    }
+
+    // items whose box overlaps box b
+    void query(const AABB& b, std::vector<uint32_t>& result)
+    {
+        if (_nodes.empty())
+            return;
+
+        _stack.clear();
+        _stack.push_back(0);
+        while (!_stack.empty()) {
+            const Node& node = _nodes[_stack.back()];
+            _stack.pop_back();
+
+            if (!_overlap(node.box, b))
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    uint32_t item = _items[node.first + i];
+                    if (_overlap(_boxes[item], b))
+                        result.push_back(item);
+                }
+            } else {
+                _stack.push_back(node.first);
+                _stack.push_back(node.first + 1);
+            }
+        }
+    }
+
+    // items whose box is hit by the ray origin + t*direction, 0 <= t <= tmax
+    void query(const glm::vec3& origin, const glm::vec3& direction, float tmax,
+               std::vector<uint32_t>& result)
+    {
+        if (_nodes.empty())
+            return;
+
+        glm::vec3 inv = _inverse(direction);
+        float t;
+
+        _stack.clear();
+        _stack.push_back(0);
+        while (!_stack.empty()) {
+            const Node& node = _nodes[_stack.back()];
+            _stack.pop_back();
+
+            if (!_hit(node.box, origin, inv, tmax, t))
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    uint32_t item = _items[node.first + i];
+                    if (_hit(_boxes[item], origin, inv, tmax, t))
+                        result.push_back(item);
+                }
+            } else {
+                _stack.push_back(node.first);
+                _stack.push_back(node.first + 1);
+            }
+        }
+    }
+
+    // closest item whose box is hit by the ray; false if there is none
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float tmax,
+                 uint32_t& item, float& distance)
+    {
+        if (_nodes.empty())
+            return false;
+
+        glm::vec3 inv = _inverse(direction);
+        float t;
+        bool found = false;
+        distance = tmax;
+
+        _stack.clear();
+        _stack.push_back(0);
+        while (!_stack.empty()) {
+            const Node& node = _nodes[_stack.back()];
+            _stack.pop_back();
+
+            // nodes behind the closest hit so far can not hold a closer one
+            if (!_hit(node.box, origin, inv, distance, t))
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; ++i) {
+                    uint32_t k = _items[node.first + i];
+                    if (_hit(_boxes[k], origin, inv, distance, t)) {
+                        item = k;
+                        distance = t;
+                        found = true;
+                    }
+                }
+            } else {
+                _stack.push_back(node.first);
+                _stack.push_back(node.first + 1);
+            }
+        }
+        return found;
+    }
+
+private:
+    // inner nodes: count == 0, children at first and first + 1
+    // leaves:      items _items[first .. first + count - 1]
+    struct Node {
+        AABB     box;
+        uint32_t first;
+        uint32_t count;
+        uint32_t parent; // the root is its own parent
+    };
+
+    static const uint32_t LEAF_SIZE = 4;
+
+    void _build(uint32_t n, uint32_t begin, uint32_t end)
+    {
+        AABB box, centers;
+        for (uint32_t i = begin; i < end; ++i) {
+            box.expand(_boxes[_items[i]]);
+            centers.expand(_boxes[_items[i]].center());
+        }
+        _nodes[n].box = box;
+
+        if (end - begin <= LEAF_SIZE) {
+            _nodes[n].first = begin;
+            _nodes[n].count = end - begin;
+            for (uint32_t i = begin; i < end; ++i)
+                _leaf[_items[i]] = n;
+            return;
+        }
+
+        // split at the median center along the longest axis
+        glm::vec3 size = centers.max - centers.min;
+        int axis = 0;
+        if (size.y > size[axis]) axis = 1;
+        if (size.z > size[axis]) axis = 2;
+
+        uint32_t mid = (begin + end) / 2;
+        const std::vector<AABB>& boxes = _boxes;
+        std::nth_element(_items.begin() + begin, _items.begin() + mid, _items.begin() + end,
+            [&boxes, axis](uint32_t a, uint32_t b) {
+                return boxes[a].min[axis] + boxes[a].max[axis] <
+                       boxes[b].min[axis] + boxes[b].max[axis];
+            });
+
+        uint32_t left = _nodes.size();
+        _nodes.push_back(Node());
+        _nodes.push_back(Node());
+        _nodes[n].first = left;
+        _nodes[n].count = 0;
+        _nodes[left].parent = n;
+        _nodes[left + 1].parent = n;
+
+        _build(left, begin, mid);
+        _build(left + 1, mid, end);
+    }
+
+    // every item below node, but the removed ones (empty boxes)
+    void _collect(const Node& node, std::vector<uint32_t>& result)
+    {
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t item = _items[node.first + i];
+                if (!_boxes[item].empty())
+                    result.push_back(item);
+            }
+            return;
+        }
+        _collect(_nodes[node.first], result);
+        _collect(_nodes[node.first + 1], result);
+    }
+
+    static bool _overlap(const AABB& a, const AABB& b)
+    {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+               a.min.y <= b.max.y && a.max.y >= b.min.y &&
+               a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+    static glm::vec3 _inverse(const glm::vec3& d)
+    {
+        return glm::vec3(d.x != 0.0f ? 1.0f / d.x : FLT_MAX,
+                         d.y != 0.0f ? 1.0f / d.y : FLT_MAX,
+                         d.z != 0.0f ? 1.0f / d.z : FLT_MAX);
+    }
+
+    // slab test; t is the entry distance
+    static bool _hit(const AABB& b, const glm::vec3& o, const glm::vec3& inv,
+                     float tmax, float& t)
+    {
+        if (b.empty())
+            return false;
+
+        float tmin = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            float t0 = (b.min[i] - o[i]) * inv[i];
+            float t1 = (b.max[i] - o[i]) * inv[i];
+            if (t0 > t1) std::swap(t0, t1);
+            tmin = std::max(tmin, t0);
+            tmax = std::min(tmax, t1);
+            if (tmin > tmax)
+                return false;
+        }
+        t = tmin;
+        return true;
+    }
+
+    std::vector<AABB>     _boxes;
+    std::vector<uint32_t> _items;
+    std::vector<Node>     _nodes;
+    std::vector<uint32_t> _leaf;   // per item, the leaf holding it
+    std::vector<uint32_t> _moved;  // items moved since the last refit
+    std::vector<uint32_t> _stack;
+};
+#endif // BVH_H
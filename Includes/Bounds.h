@@ -0,0 +1,145 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <vector>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BOUNDS_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+// Axis-aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // empty box: expanding it by any point gives that point
+    AABB()
+        : min(FLT_MAX), max(-FLT_MAX)
+    { }
+
+    AABB(glm::vec3 lo, glm::vec3 hi)
+        : min(lo), max(hi)
+    { }
+
+    bool empty() const
+    { return min.x > max.x; }
+
+    glm::vec3 center() const
+    { return 0.5f * (min + max); }
+
+    // half size
+    glm::vec3 extent() const
+    { return 0.5f * (max - min); }
+
+    void expand(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB& b)
+    {
+        if (b.empty())
+            return;
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    // bounds of this box after transformation by m (Arvo's method: the
+    // center is transformed, the extent by the absolute matrix)
+    AABB transformed(const glm::mat4& m) const
+    {
+        if (empty())
+            return *this;
+
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extent();
+        glm::vec3 r;
+        for (int i = 0; i < 3; ++i) {
+            r[i] = std::fabs(m[0][i]) * e.x +
+                   std::fabs(m[1][i]) * e.y +
+                   std::fabs(m[2][i]) * e.z;
+        }
+        return AABB(c - r, c + r);
+    }
+
+    // bounds of count points starting at first, stride bytes apart (e.g.
+    // the positions of an interleaved vertex array); min/max reduction
+    // over whole xyz points with SSE
+    static AABB of_points(const glm::vec3* first, size_t count, size_t stride)
+    {
+        AABB b;
+        if (count == 0)
+            return b;
+
+        const char* p = reinterpret_cast<const char*>(first);
+        size_t i = 0;
+#ifdef BOUNDS_SSE
+        // a 4-float load reads one float past the point, so the last point
+        // is left to the scalar loop
+        __m128 lo = _mm_set1_ps(FLT_MAX), hi = _mm_set1_ps(-FLT_MAX);
+        for (; i + 1 < count; ++i) {
+            __m128 v = _mm_loadu_ps(reinterpret_cast<const float*>(p + i * stride));
+            lo = _mm_min_ps(lo, v);
+            hi = _mm_max_ps(hi, v);
+        }
+        float l[4], h[4];
+        _mm_storeu_ps(l, lo);
+        _mm_storeu_ps(h, hi);
+        b.min = glm::vec3(l[0], l[1], l[2]);
+        b.max = glm::vec3(h[0], h[1], h[2]);
+#endif
+        for (; i < count; ++i)
+            b.expand(*reinterpret_cast<const glm::vec3*>(p + i * stride));
+        return b;
+    }
+
+    bool operator==(const AABB& b) const
+    { return min == b.min && max == b.max; }
+
+    bool operator!=(const AABB& b) const
+    { return !(*this == b); }
+};
+
+// Boxes stored as center/extent component arrays, the layout used by the
+// SIMD batch tests (see Frustum::cull)
+struct AABBArray {
+    std::vector<float> cx, cy, cz;
+    std::vector<float> ex, ey, ez;
+
+    size_t size() const
+    { return cx.size(); }
+
+    void clear()
+    {
+        cx.clear(); cy.clear(); cz.clear();
+        ex.clear(); ey.clear(); ez.clear();
+    }
+
+    void push_back(const AABB& b)
+    {
+        glm::vec3 c = b.center(), e = b.extent();
+        cx.push_back(c.x); cy.push_back(c.y); cz.push_back(c.z);
+        ex.push_back(e.x); ey.push_back(e.y); ez.push_back(e.z);
+    }
+
+    void set(size_t i, const AABB& b)
+    {
+        glm::vec3 c = b.center(), e = b.extent();
+        cx[i] = c.x; cy[i] = c.y; cz[i] = c.z;
+        ex[i] = e.x; ey[i] = e.y; ez[i] = e.z;
+    }
+
+    AABB get(size_t i) const
+    {
+        glm::vec3 c(cx[i], cy[i], cz[i]), e(ex[i], ey[i], ez[i]);
+        return AABB(c - e, c + e);
+    }
+};
+
+#endif // BOUNDS_H
@@ -0,0 +1,226 @@
+#ifndef CHUNK_CACHE_H
+#define CHUNK_CACHE_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Terrain.h>
+#include <ChunkMesher.h>
+
+// directory the chunk caches live in
+#define CHUNK_CACHE_DIR "Cache"
+// bumped whenever the file layout or the terrain generation changes
+#define CHUNK_CACHE_VERSION 1
+
+// Generated chunks kept on disk across runs, one file per chunk under a
+// directory named after the key of everything the chunk depends on: the
+// terrain parameters, the chunk size and the layout of the vertices. A
+// file is a fixed header followed by the heights, the biomes and the faces
+// of the chunk, all in the layout they have in memory, so load() maps it
+// and copies the arrays out. Files are written under a temporary name and
+// renamed, so a crash never leaves a partial chunk behind. Chunks can be
+// loaded and stored from any number of threads at once.
+class ChunkCache {
+public:
+    // cells of the heights and biomes of a chunk, border included
+    static const int CELLS = (CHUNK_SIZE + 2) * (CHUNK_SIZE + 2);
+
+    ChunkCache(const std::string& root = CHUNK_CACHE_DIR)
+        : _root(root)
+    { }
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    // hash of everything the chunks generated from p depend on, besides
+    // its regions: chunks under a region are not cached
+    static uint64_t key(const TerrainParameters& p)
+    {
+        uint64_t parameters[4 + TERRAIN_OCTAVES + 4];
+        uint64_t* q = parameters;
+        *q++ = CHUNK_CACHE_VERSION;
+        *q++ = (uint64_t)TERRAIN_NOISE;
+        *q++ = (uint64_t)p.seed();
+        *q++ = _bits(p.frequency());
+        for (int o = 0; o < TERRAIN_OCTAVES; ++o)
+            *q++ = _bits(p.weight(o));
+        *q++ = CHUNK_SIZE;
+        *q++ = _bits(CHUNK_CELL);
+        *q++ = sizeof(Vertex);
+        *q++ = sizeof(Face);
+        return _hash(parameters, sizeof(parameters));
+    }
+
+    // faces of chunk (x, z) and, if not NULL, its CELLS heights and biomes;
+    // false if the chunk is not cached
+    bool load(uint64_t key, int x, int z, ChunkGeometry& g, float* heights = NULL, uint8_t* biomes = NULL)
+    {
+        std::string path = _path(key, x, z);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+            close(fd);
+            return false;
+        }
+
+        size_t size = st.st_size;
+        void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        const char* p = (const char*)map;
+        Header h;
+        memcpy(&h, p, sizeof(h));
+        bool valid = memcmp(h.magic, "CHNK", 4) == 0 && h.key == key && h.x == x && h.z == z
+                     && size == _size(h);
+        if (valid) {
+            p += sizeof(Header);
+            if (heights)
+                memcpy(heights, p, CELLS * sizeof(float));
+            p += CELLS * sizeof(float);
+            if (biomes)
+                memcpy(biomes, p, CELLS);
+            p += _padded(CELLS);
+
+            g.x = x;
+            g.z = z;
+            p = _read(p, g.top_vertices, h.top_vertices);
+            p = _read(p, g.top_faces, h.top_faces);
+            p = _read(p, g.side_vertices, h.side_vertices);
+            p = _read(p, g.side_faces, h.side_faces);
+            g.occluder = AABB(glm::vec3(h.occluder[0], h.occluder[1], h.occluder[2]),
+                              glm::vec3(h.occluder[3], h.occluder[4], h.occluder[5]));
+        }
+
+        munmap(map, size);
+        return valid;
+    }
+
+    // saves chunk (x, z); heights and biomes hold CELLS values each
+    void store(uint64_t key, int x, int z, const float* heights, const uint8_t* biomes, const ChunkGeometry& g)
+    {
+        Header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "CHNK", 4);
+        h.key = key;
+        h.x = x;
+        h.z = z;
+        h.top_vertices = g.top_vertices.size();
+        h.top_faces = g.top_faces.size();
+        h.side_vertices = g.side_vertices.size();
+        h.side_faces = g.side_faces.size();
+        const float occluder[6] = { g.occluder.min.x, g.occluder.min.y, g.occluder.min.z,
+                                    g.occluder.max.x, g.occluder.max.y, g.occluder.max.z };
+        memcpy(h.occluder, occluder, sizeof(occluder));
+
+        // fails harmlessly if they exist; if they cannot be made, fopen
+        // fails and the chunk is generated again next time
+        std::string dir = _dir(key);
+        mkdir(_root.c_str(), 0755);
+        mkdir(dir.c_str(), 0755);
+
+        std::string path = _path(key, x, z);
+        std::ostringstream temporary_name;
+        temporary_name << path << "." << std::this_thread::get_id() << ".tmp";
+        std::string temporary = temporary_name.str();
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (file == NULL)
+            return;
+
+        static const char padding[4] = { 0, 0, 0, 0 };
+        bool written = fwrite(&h, sizeof(h), 1, file) == 1
+                       && fwrite(heights, sizeof(float), CELLS, file) == CELLS
+                       && fwrite(biomes, 1, CELLS, file) == CELLS
+                       && fwrite(padding, 1, _padded(CELLS) - CELLS, file) == _padded(CELLS) - CELLS
+                       && _write(file, g.top_vertices) && _write(file, g.top_faces)
+                       && _write(file, g.side_vertices) && _write(file, g.side_faces);
+        written = fclose(file) == 0 && written;
+
+        if (!written || rename(temporary.c_str(), path.c_str()) != 0)
+            remove(temporary.c_str());
+    }
+
+private:
+    struct Header {
+        char      magic[4];
+        int32_t   x, z;
+        uint32_t  top_vertices, top_faces;
+        uint32_t  side_vertices, side_faces;
+        float     occluder[6];   // min then max
+        uint64_t  key;
+    };
+
+    // FNV-1a
+    static uint64_t _hash(const void* data, size_t size)
+    {
+        const unsigned char* p = (const unsigned char*)data;
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ p[i]) * 1099511628211ull;
+        return h;
+    }
+
+    // the arrays after the biomes stay 4 byte aligned
+    static size_t _padded(size_t size)
+    { return (size + 3) & ~(size_t)3; }
+
+    static size_t _size(const Header& h)
+    {
+        return sizeof(Header) + CELLS * sizeof(float) + _padded(CELLS)
+               + (size_t)(h.top_vertices + h.side_vertices) * sizeof(Vertex)
+               + (size_t)(h.top_faces + h.side_faces) * sizeof(Face);
+    }
+
+    template <typename T>
+    static const char* _read(const char* p, std::vector<T>& v, uint32_t count)
+    {
+        v.resize(count);
+        memcpy(v.data(), p, count * sizeof(T));
+        return p + count * sizeof(T);
+    }
+
+    template <typename T>
+    static bool _write(FILE* file, const std::vector<T>& v)
+    { return v.empty() || fwrite(v.data(), sizeof(T), v.size(), file) == v.size(); }
+
+    template <typename T>
+    static uint64_t _bits(T value)
+    {
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(T));
+        return bits;
+    }
+
+    std::string _dir(uint64_t key)
+    {
+        std::ostringstream dir;
+        dir << _root << "/" << std::hex << std::setw(16) << std::setfill('0') << key;
+        return dir.str();
+    }
+
+    std::string _path(uint64_t key, int x, int z)
+    {
+        std::ostringstream path;
+        path << _dir(key) << "/" << x << "_" << z << ".chunk";
+        return path.str();
+    }
+
+    std::string  _root;
+};
+
+#endif
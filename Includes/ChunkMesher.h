@@ -0,0 +1,274 @@
+#ifndef CHUNK_MESHER_H
+#define CHUNK_MESHER_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <Vertex.h>
+#include <Material.h>
+#include <Bounds.h>
+#include <MeshResource.h>
+#include <Model.h> // and stb_image
+
+// cells along each side of a chunk
+#define CHUNK_SIZE 16
+// world size of a cell (a block is 2 units wide)
+#define CHUNK_CELL 2.0f
+
+// Faces of a chunk, built off the GL thread and uploaded on it.
+struct ChunkGeometry {
+    int                  x, z;           // chunk coordinates
+    std::vector<Vertex>  top_vertices, side_vertices;
+    std::vector<Face>    top_faces, side_faces;
+    AABB                 occluder;
+};
+
+// Turns a chunk heightmap into block terrain. Every column of blocks is
+// solid up to its height; only faces open to the air are kept, and
+// neighbouring faces in the same plane with the same texture are merged
+// into larger quads (greedy meshing). Tops and sides use different tiles
+// of the block texture, so a chunk is a model of two meshes, one per
+// tile; texture coordinates count blocks and the tiles repeat.
+class ChunkMesher {
+public:
+    ChunkMesher()
+    {
+        _top.id = 0;
+        _side.id = 0;
+    }
+
+    ~ChunkMesher()
+    { release(); }
+
+    // delete the block textures while the context is still there
+    void release()
+    {
+        if (_top.id)
+            glDeleteTextures(1, &_top.id);
+        if (_side.id)
+            glDeleteTextures(1, &_side.id);
+        _top.id = 0;
+        _side.id = 0;
+    }
+
+    ChunkMesher(const ChunkMesher&) = delete;
+    ChunkMesher& operator=(const ChunkMesher&) = delete;
+
+    // block texture laid out as an unfolded cube, 3 x 4 tiles, top in the
+    // middle of the second row from the top and a side below it
+    void load(const char* texture_path, const Material& material)
+    {
+        int w, h, channels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char* pixels = stbi_load(texture_path, &w, &h, &channels, 3);
+        if (pixels == NULL) {
+            std::cout << "Failed to load texture " << texture_path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // rows are flipped, so tile rows count from the bottom
+        _top  = _tile(pixels, w, h, 1, 2);
+        _side = _tile(pixels, w, h, 1, 1);
+        stbi_image_free(pixels);
+
+        _material = material;
+    }
+
+    // faces of the chunk whose first cell is (x0, z0); heights holds
+    // (CHUNK_SIZE + 2)^2 cells, row by row, starting at (x0 - 1, z0 - 1) so
+    // the faces on the chunk border can see their neighbours. Touches no GL
+    // state nor the mesher, so any thread can call it
+    static void mesh(const float* heights, int x0, int z0, ChunkGeometry& g)
+    {
+        const int S = CHUNK_SIZE, B = CHUNK_SIZE + 2;
+        int height[B * B];
+        for (int i = 0; i < B * B; ++i)
+            height[i] = (int)std::ceil(heights[i]);
+        // height of cell (x, z) of the chunk, -1 and CHUNK_SIZE are neighbours
+        auto cell = [&](int x, int z) { return height[(z + 1) * B + x + 1]; };
+
+        std::vector<int> mask;
+        g.top_vertices.clear();
+        g.top_faces.clear();
+        g.side_vertices.clear();
+        g.side_faces.clear();
+
+        // tops: one layer, merged where the height is the same
+        int lowest = cell(0, 0);
+        for (int z = 0; z < S; ++z)
+            for (int x = 0; x < S; ++x)
+                lowest = std::min(lowest, cell(x, z));
+
+        mask.assign(S * S, 0);
+        for (int z = 0; z < S; ++z)
+            for (int x = 0; x < S; ++x)
+                mask[z * S + x] = cell(x, z) - lowest + 1;
+
+        _greedy(mask, S, S, [&](int x, int z, int w, int d, int v) {
+            // a block of height h spans [h, h + 1] cells
+            float y = (v + lowest) * CHUNK_CELL;
+            glm::vec3 o(_edge(x0 + x), y, _edge(z0 + z));
+            _quad(g.top_vertices, g.top_faces, o, glm::vec3(w * CHUNK_CELL, 0, 0),
+                  glm::vec3(0, 0, d * CHUNK_CELL), glm::vec3(0, 1, 0), w, d);
+        });
+
+        // sides: a column shows the blocks above its neighbour's top, one
+        // plane per cell boundary, merged along the plane and vertically
+        static const int dirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+        for (int k = 0; k < 4; ++k) {
+            int dx = dirs[k][0], dz = dirs[k][1];
+            glm::vec3 normal((float)dx, 0.0f, (float)dz);
+            glm::vec3 along(dz != 0 ? 1.0f : 0.0f, 0.0f, dx != 0 ? 1.0f : 0.0f);
+
+            for (int s = 0; s < S; ++s) {
+                // heights of the blocks exposed in this plane, (bottom, top]
+                int bottom = INT_MAX, top = INT_MIN;
+                for (int t = 0; t < S; ++t) {
+                    int x = dx ? s : t, z = dx ? t : s;
+                    int own = cell(x, z), next = cell(x + dx, z + dz);
+                    if (own > next) {
+                        bottom = std::min(bottom, next);
+                        top = std::max(top, own);
+                    }
+                }
+                if (top == INT_MIN)
+                    continue;
+
+                int levels = top - bottom;
+                mask.assign(S * levels, 0);
+                for (int t = 0; t < S; ++t) {
+                    int x = dx ? s : t, z = dx ? t : s;
+                    int own = cell(x, z), next = cell(x + dx, z + dz);
+                    for (int l = next; l < own; ++l)
+                        mask[(l - bottom) * S + t] = 1;
+                }
+
+                // plane through the cell boundary facing (dx, dz)
+                int x = dx ? s : 0, z = dx ? 0 : s;
+                glm::vec3 plane(_edge(x0 + x) + (dx > 0) * CHUNK_CELL, 0,
+                                _edge(z0 + z) + (dz > 0) * CHUNK_CELL);
+
+                _greedy(mask, S, levels, [&](int t, int l, int w, int hgt, int) {
+                    // mask row l holds the block at height bottom + l + 1
+                    glm::vec3 o = plane + along * (t * CHUNK_CELL);
+                    o.y = (bottom + l + 1) * CHUNK_CELL;
+                    _quad(g.side_vertices, g.side_faces, o, along * (w * CHUNK_CELL),
+                          glm::vec3(0, hgt * CHUNK_CELL, 0), normal, w, hgt);
+                });
+            }
+        }
+
+        // everything below the lowest top is solid
+        float y = (lowest + 1) * CHUNK_CELL;
+        g.occluder = AABB(glm::vec3(_edge(x0), y - CHUNK_CELL, _edge(z0)),
+                          glm::vec3(_edge(x0 + S), y, _edge(z0 + S)));
+    }
+
+    // uploads the faces as a model, on the GL thread; g is left empty
+    Model model(ChunkGeometry& g)
+    {
+        Model model;
+        if (!g.top_faces.empty())
+            model.add_mesh(Mesh(std::move(g.top_vertices), std::move(g.top_faces), _material, _top));
+        if (!g.side_faces.empty())
+            model.add_mesh(Mesh(std::move(g.side_vertices), std::move(g.side_faces), _material, _side));
+        model.set_occluder(g.occluder);
+        return model;
+    }
+
+private:
+
+    // world coordinate of the low edge of cell c (blocks are centered on
+    // their cell)
+    static float _edge(int c)
+    { return c * CHUNK_CELL - 0.5f * CHUNK_CELL; }
+
+    // splits the non-zero cells of mask (w x h, row by row) into
+    // rectangles of equal value and calls emit(x, y, w, h, value) for each
+    template <typename F>
+    static void _greedy(std::vector<int>& mask, int w, int h, F emit)
+    {
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ) {
+                int v = mask[y * w + x];
+                if (v == 0) {
+                    ++x;
+                    continue;
+                }
+
+                int rw = 1;
+                while (x + rw < w && mask[y * w + x + rw] == v)
+                    ++rw;
+
+                int rh = 1;
+                for (; y + rh < h; ++rh) {
+                    int k = 0;
+                    while (k < rw && mask[(y + rh) * w + x + k] == v)
+                        ++k;
+                    if (k < rw)
+                        break;
+                }
+
+                for (int j = 0; j < rh; ++j)
+                    std::fill(&mask[(y + j) * w + x], &mask[(y + j) * w + x] + rw, 0);
+
+                emit(x, y, rw, rh, v);
+                x += rw;
+            }
+        }
+    }
+
+    // quad o, o + du, o + du + dv, o + dv facing n, its texture repeated
+    // uw x vh times
+    static void _quad(std::vector<Vertex>& vertices, std::vector<Face>& faces,
+                      glm::vec3 o, glm::vec3 du, glm::vec3 dv, glm::vec3 n, float uw, float vh)
+    {
+        GLuint b = vertices.size();
+        Vertex v[4] = {
+            { o,           n, glm::vec2(0.0f, 0.0f) },
+            { o + du,      n, glm::vec2(uw,   0.0f) },
+            { o + du + dv, n, glm::vec2(uw,   vh)   },
+            { o + dv,      n, glm::vec2(0.0f, vh)   },
+        };
+        vertices.insert(vertices.end(), v, v + 4);
+
+        // counter-clockwise seen from the side n points to
+        if (glm::dot(glm::cross(du, dv), n) > 0) {
+            faces.push_back(Face { glm::uvec3(b, b + 1, b + 2) });
+            faces.push_back(Face { glm::uvec3(b, b + 2, b + 3) });
+        } else {
+            faces.push_back(Face { glm::uvec3(b, b + 2, b + 1) });
+            faces.push_back(Face { glm::uvec3(b, b + 3, b + 2) });
+        }
+    }
+
+    // copy of tile (column, row) of a 3 x 4 tile texture, as its own
+    // texture so that it can repeat
+    static Texture _tile(const unsigned char* pixels, int w, int h, int column, int row)
+    {
+        int tw = w / 3, th = h / 4;
+        std::vector<unsigned char> tile(tw * th * 3);
+        for (int y = 0; y < th; ++y)
+            memcpy(&tile[y * tw * 3], pixels + ((row * th + y) * w + column * tw) * 3, tw * 3);
+
+        Texture t = { 0, tw, th, tile.data() };
+        upload_texture(t);
+        t.data = NULL;
+        return t;
+    }
+
+    Texture              _top, _side;
+    Material             _material;
+};
+
+#endif
@@ -51,6 +51,12 @@
 #define FASTNOISELITE_H
 
 #include <cmath>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FNL_SIMD
+#endif
 
 class FastNoiseLite
 {
@@ -338,6 +344,230 @@ public:
         }
     }
 
+    /// <summary>
+    /// 2D noise at count positions (xs[i], ys[i]) using current settings,
+    /// written to output[i]
+    /// </summary>
+    /// <remarks>
+    /// Same values as GetNoise(xs[i], ys[i]). OpenSimplex2 and Perlin noise
+    /// without fractal are evaluated 8 positions at a time with AVX2 or
+    /// SSE4.1, whichever the CPU supports
+    /// </remarks>
+    void GetNoiseSet(const float* xs, const float* ys, float* output, size_t count)
+    {
+        if (mFractalType == FractalType_None)
+        {
+            switch (mNoiseType)
+            {
+            case NoiseType_OpenSimplex2:
+                GetNoiseSetFixed<NoiseType_OpenSimplex2>(xs, ys, output, count);
+                return;
+            case NoiseType_Perlin:
+                GetNoiseSetFixed<NoiseType_Perlin>(xs, ys, output, count);
+                return;
+            default:
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            output[i] = GetNoise(xs[i], ys[i]);
+        }
+    }
+
+    /// <summary>
+    /// 2D noise with the noise type, fractal type and octave count fixed at
+    /// compile time, using the other current settings
+    /// </summary>
+    /// <remarks>
+    /// No type switch is left in the call and the octave loop is unrolled.
+    /// Same values as GetNoise when the runtime settings match the template
+    /// arguments
+    /// </remarks>
+    template <NoiseType Type, FractalType Fractal = FractalType_None, int Octaves = 1, typename FNfloat>
+    float GetNoiseFixed(FNfloat x, FNfloat y)
+    {
+        Arguments_must_be_floating_point_values<FNfloat>();
+        static_assert(Octaves >= 1, "at least one octave");
+
+        TransformNoiseCoordinateFixed<Type>(x, y);
+
+        return GenFractalFixed<Type, Fractal, Octaves>(x, y);
+    }
+
+    /// <summary>
+    /// GetNoiseSet with the noise type, fractal type and octave count fixed
+    /// at compile time, as GetNoiseFixed
+    /// </summary>
+    template <NoiseType Type, FractalType Fractal = FractalType_None, int Octaves = 1>
+    void GetNoiseSetFixed(const float* xs, const float* ys, float* output, size_t count)
+    {
+        size_t i = 0;
+#ifdef FNL_SIMD
+        if (Fractal == FractalType_None &&
+            (Type == NoiseType_OpenSimplex2 || Type == NoiseType_Perlin))
+        {
+            switch (SimdLevel())
+            {
+            case SimdLevel_AVX2:
+                i = GenNoiseSetAVX2<Type>(xs, ys, output, count);
+                break;
+            case SimdLevel_SSE41:
+                i = GenNoiseSetSSE41<Type>(xs, ys, output, count);
+                break;
+            default:
+                break;
+            }
+        }
+#endif
+        for (; i < count; i++)
+        {
+            output[i] = GetNoiseFixed<Type, Fractal, Octaves>(xs[i], ys[i]);
+        }
+    }
+
+    /// <summary>
+    /// 2D noise on a width x height grid using current settings, written
+    /// row by row to output
+    /// </summary>
+    /// <remarks>
+    /// Sample (x, y) is at (xStart + x * step, yStart + y * step), computed in float
+    /// </remarks>
+    void GetNoiseGrid(float xStart, float yStart, float step, int width, int height, float* output)
+    {
+        const int BLOCK = 64;
+        float xs[BLOCK], ys[BLOCK];
+
+        for (int y = 0; y < height; y++)
+        {
+            float yPos = yStart + y * step;
+            for (int x = 0; x < width; x += BLOCK)
+            {
+                int n = width - x < BLOCK ? width - x : BLOCK;
+                for (int k = 0; k < n; k++)
+                {
+                    xs[k] = xStart + (x + k) * step;
+                    ys[k] = yPos;
+                }
+                GetNoiseSet(xs, ys, output + (size_t)y * width + x, n);
+            }
+        }
+    }
+
+    /// <summary>
+    /// 2D noise at given position using current settings, and its gradient
+    /// </summary>
+    /// <remarks>
+    /// dx and dy receive the derivatives of the noise along x and y. They
+    /// are analytic, from the same evaluation as the value, for OpenSimplex2
+    /// and Perlin noise without fractal or with FBm; other settings fall
+    /// back to central differences. The value is the same as GetNoise(x, y)
+    /// </remarks>
+    /// <returns>
+    /// Noise output bounded between -1...1
+    /// </returns>
+    template <typename FNfloat>
+    float GetNoiseGradient(FNfloat x, FNfloat y, float& dx, float& dy)
+    {
+        Arguments_must_be_floating_point_values<FNfloat>();
+
+        if ((mNoiseType != NoiseType_OpenSimplex2 && mNoiseType != NoiseType_Perlin) ||
+            (mFractalType != FractalType_None && mFractalType != FractalType_FBm))
+        {
+            // a thousandth of a noise cell
+            FNfloat h = (FNfloat)(0.001f / mFrequency);
+            dx = (float)((GetNoise(x + h, y) - GetNoise(x - h, y)) / (2 * h));
+            dy = (float)((GetNoise(x, y + h) - GetNoise(x, y - h)) / (2 * h));
+            return GetNoise(x, y);
+        }
+
+        TransformNoiseCoordinate(x, y);
+
+        float noise = mFractalType == FractalType_FBm ?
+            GenFractalFBmGradient(x, y, dx, dy) : GenNoiseSingleGradient(mSeed, x, y, dx, dy);
+        dx *= mFrequency;
+        dy *= mFrequency;
+        return noise;
+    }
+
+    /// <summary>
+    /// GetNoiseGradient at count positions (xs[i], ys[i]), written to
+    /// output[i], dxs[i] and dys[i]
+    /// </summary>
+    /// <remarks>
+    /// OpenSimplex2 and Perlin noise without fractal are evaluated 8
+    /// positions at a time, as GetNoiseSet
+    /// </remarks>
+    void GetNoiseGradientSet(const float* xs, const float* ys, float* output, float* dxs, float* dys, size_t count)
+    {
+        if (mFractalType == FractalType_None)
+        {
+            switch (mNoiseType)
+            {
+            case NoiseType_OpenSimplex2:
+                GetNoiseGradientSetFixed<NoiseType_OpenSimplex2>(xs, ys, output, dxs, dys, count);
+                return;
+            case NoiseType_Perlin:
+                GetNoiseGradientSetFixed<NoiseType_Perlin>(xs, ys, output, dxs, dys, count);
+                return;
+            default:
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            output[i] = GetNoiseGradient(xs[i], ys[i], dxs[i], dys[i]);
+        }
+    }
+
+    /// <summary>
+    /// GetNoiseGradientSet with no fractal and the noise type fixed at
+    /// compile time
+    /// </summary>
+    /// <remarks>
+    /// Values are the same as GetNoiseSetFixed&lt;Type&gt;. Types other than
+    /// OpenSimplex2 and Perlin go through GetNoiseGradient, so the runtime
+    /// settings must match
+    /// </remarks>
+    template <NoiseType Type>
+    void GetNoiseGradientSetFixed(const float* xs, const float* ys, float* output, float* dxs, float* dys, size_t count)
+    {
+        if (Type != NoiseType_OpenSimplex2 && Type != NoiseType_Perlin)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                output[i] = GetNoiseGradient(xs[i], ys[i], dxs[i], dys[i]);
+            }
+            return;
+        }
+
+        size_t i = 0;
+#ifdef FNL_SIMD
+        switch (SimdLevel())
+        {
+        case SimdLevel_AVX2:
+            i = GenNoiseGradientSetAVX2<Type>(xs, ys, output, dxs, dys, count);
+            break;
+        case SimdLevel_SSE41:
+            i = GenNoiseGradientSetSSE41<Type>(xs, ys, output, dxs, dys, count);
+            break;
+        default:
+            break;
+        }
+#endif
+        for (; i < count; i++)
+        {
+            float x = xs[i], y = ys[i];
+            TransformNoiseCoordinateFixed<Type>(x, y);
+            output[i] = Type == NoiseType_OpenSimplex2 ?
+                SingleSimplexGradient(mSeed, x, y, dxs[i], dys[i]) : SinglePerlinGradient(mSeed, x, y, dxs[i], dys[i]);
+            dxs[i] *= mFrequency;
+            dys[i] *= mFrequency;
+        }
+    }
+
 
     /// <summary>
     /// 2D warps the input position using current domain warp settings
@@ -458,6 +688,8 @@ private:
 
     static float InterpQuintic(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
 
+    static float InterpQuinticDerivative(float t) { return t * t * (t * (t * 30 - 60) + 30); }
+
     static float CubicLerp(float a, float b, float c, float d, float t)
     {
         float p = (d - c) - (a - b);
@@ -539,6 +771,18 @@ private:
     }
 
 
+    // the gradient GradCoord takes the dot product with
+    void GradVector(int seed, int xPrimed, int yPrimed, float& xg, float& yg)
+    {
+        int hash = Hash(seed, xPrimed, yPrimed);
+        hash ^= hash >> 15;
+        hash &= 127 << 1;
+
+        xg = Lookup<float>::Gradients2D[hash];
+        yg = Lookup<float>::Gradients2D[hash | 1];
+    }
+
+
     float GradCoord(int seed, int xPrimed, int yPrimed, int zPrimed, float xd, float yd, float zd)
     {
         int hash = Hash(seed, xPrimed, yPrimed, zPrimed);
@@ -635,6 +879,16 @@ private:
         }
     }
 
+    // gradient along the transformed coordinates, before the skew:
+    // OpenSimplex2 or Perlin only
+    template <typename FNfloat>
+    float GenNoiseSingleGradient(int seed, FNfloat x, FNfloat y, float& dx, float& dy)
+    {
+        if (mNoiseType == NoiseType_OpenSimplex2)
+            return SingleSimplexGradient(seed, x, y, dx, dy);
+        return SinglePerlinGradient(seed, x, y, dx, dy);
+    }
+
     template <typename FNfloat>
     float GenNoiseSingle(int seed, FNfloat x, FNfloat y, FNfloat z)
     {
@@ -658,6 +912,494 @@ private:
     }
 
 
+    // Batch noise gen
+    //
+    // Kernels are written once with 8 wide GCC vector types and compiled
+    // for AVX2 and SSE4.1 (as pairs of 4 wide operations); GetNoiseSet
+    // picks one at run time. Every operation mirrors the scalar code, so
+    // results are identical. Vectors are passed by reference: by value,
+    // 32 byte vectors would trip the AVX ABI warning in non AVX builds.
+
+#ifdef FNL_SIMD
+    typedef float FNvf __attribute__((vector_size(32)));
+    typedef int FNvi __attribute__((vector_size(32)));
+    typedef unsigned FNvu __attribute__((vector_size(32)));
+
+    static const int SIMD_WIDTH = 8;
+
+    enum SimdLevelType
+    {
+        SimdLevel_None,
+        SimdLevel_SSE41,
+        SimdLevel_AVX2
+    };
+
+    static SimdLevelType SimdLevel()
+    {
+        static const SimdLevelType level =
+            __builtin_cpu_supports("avx2") ? SimdLevel_AVX2 :
+            __builtin_cpu_supports("sse4.1") ? SimdLevel_SSE41 : SimdLevel_None;
+        return level;
+    }
+
+    template <NoiseType Type>
+    __attribute__((target("avx2")))
+    size_t GenNoiseSetAVX2(const float* xs, const float* ys, float* output, size_t count)
+    {
+        return GenNoiseSetBlocks<Type>(xs, ys, output, count);
+    }
+
+    template <NoiseType Type>
+    __attribute__((target("sse4.1")))
+    size_t GenNoiseSetSSE41(const float* xs, const float* ys, float* output, size_t count)
+    {
+        return GenNoiseSetBlocks<Type>(xs, ys, output, count);
+    }
+
+    // fills whole blocks of SIMD_WIDTH outputs, returns how many were done;
+    // Type is OpenSimplex2 or Perlin
+    template <NoiseType Type>
+    __attribute__((always_inline))
+    inline size_t GenNoiseSetBlocks(const float* xs, const float* ys, float* output, size_t count)
+    {
+        const float SQRT3 = (float)1.7320508075688772935274463415059;
+        const float F2 = 0.5f * (SQRT3 - 1);
+
+        size_t i = 0;
+        for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+        {
+            FNvf x, y, n;
+            memcpy(&x, xs + i, sizeof(x));
+            memcpy(&y, ys + i, sizeof(y));
+
+            x *= mFrequency;
+            y *= mFrequency;
+
+            if (Type == NoiseType_OpenSimplex2)
+            {
+                FNvf t = (x + y) * F2;
+                x += t;
+                y += t;
+                BlockSimplex(n, mSeed, x, y);
+            }
+            else
+            {
+                BlockPerlin(n, mSeed, x, y);
+            }
+
+            memcpy(output + i, &n, sizeof(n));
+        }
+        return i;
+    }
+
+    // out = mask ? a : b, lane by lane
+    template <typename V>
+    __attribute__((always_inline))
+    static inline void VecSelect(V& out, const FNvi& mask, const V& a, const V& b)
+    {
+        out = (V)(((FNvi)a & mask) | ((FNvi)b & ~mask));
+    }
+
+    __attribute__((always_inline))
+    static inline void VecFloor(FNvi& out, const FNvf& f)
+    {
+        // (int)f, less one where f < 0, as FastFloor
+        out = __builtin_convertvector(f, FNvi) + ~(FNvi)(f >= 0);
+    }
+
+    __attribute__((always_inline))
+    static inline void VecMulPrime(FNvi& v, int prime)
+    {
+        v = (FNvi)((FNvu)v * (unsigned)prime);
+    }
+
+    __attribute__((always_inline))
+    static inline void VecGradCoord(FNvf& out, int seed, const FNvi& xPrimed, const FNvi& yPrimed, const FNvf& xd, const FNvf& yd)
+    {
+        FNvi hash = (FNvi)(((FNvu)(seed ^ xPrimed ^ yPrimed)) * 0x27d4eb2du);
+        hash ^= hash >> 15;
+        hash &= 127 << 1;
+
+        FNvf xg, yg;
+        for (int l = 0; l < SIMD_WIDTH; l++)
+        {
+            xg[l] = Lookup<float>::Gradients2D[hash[l]];
+            yg[l] = Lookup<float>::Gradients2D[hash[l] | 1];
+        }
+
+        out = xd * xg + yd * yg;
+    }
+
+    // SingleSimplex on a block of skewed coordinates
+    __attribute__((always_inline))
+    static inline void BlockSimplex(FNvf& out, int seed, const FNvf& x, const FNvf& y)
+    {
+        const float SQRT3 = 1.7320508075688772935274463415059f;
+        const float G2 = (3 - SQRT3) / 6;
+        const float C1 = (float)(2 * (1 - 2 * G2) * (1 / G2 - 2));
+        const float C2 = (float)(-2 * (1 - 2 * G2) * (1 - 2 * G2));
+        const FNvf zero = {};
+
+        FNvi i, j;
+        VecFloor(i, x);
+        VecFloor(j, y);
+        FNvf xi = x - __builtin_convertvector(i, FNvf);
+        FNvf yi = y - __builtin_convertvector(j, FNvf);
+
+        FNvf t = (xi + yi) * G2;
+        FNvf x0 = xi - t;
+        FNvf y0 = yi - t;
+
+        VecMulPrime(i, PrimeX);
+        VecMulPrime(j, PrimeY);
+
+        FNvf g;
+
+        FNvf a = 0.5f - x0 * x0 - y0 * y0;
+        VecGradCoord(g, seed, i, j, x0, y0);
+        FNvf n0 = (a * a) * (a * a) * g;
+        VecSelect(n0, (FNvi)(a > 0), n0, zero);
+
+        FNvf c = C1 * t + (C2 + a);
+        FNvf x2 = x0 + (2 * (float)G2 - 1);
+        FNvf y2 = y0 + (2 * (float)G2 - 1);
+        VecGradCoord(g, seed, i + PrimeX, j + PrimeY, x2, y2);
+        FNvf n2 = (c * c) * (c * c) * g;
+        VecSelect(n2, (FNvi)(c > 0), n2, zero);
+
+        // second corner is (0, 1) above the diagonal, (1, 0) below it
+        FNvi upper = (FNvi)(y0 > x0);
+        FNvf x1, y1;
+        VecSelect(x1, upper, zero + (float)G2, zero + ((float)G2 - 1));
+        VecSelect(y1, upper, zero + ((float)G2 - 1), zero + (float)G2);
+        x1 += x0;
+        y1 += y0;
+        FNvi i1, j1;
+        VecSelect(i1, upper, i, i + PrimeX);
+        VecSelect(j1, upper, j + PrimeY, j);
+        FNvf b = 0.5f - x1 * x1 - y1 * y1;
+        VecGradCoord(g, seed, i1, j1, x1, y1);
+        FNvf n1 = (b * b) * (b * b) * g;
+        VecSelect(n1, (FNvi)(b > 0), n1, zero);
+
+        out = (n0 + n1 + n2) * 99.83685446303647f;
+    }
+
+    // SinglePerlin on a block of coordinates
+    __attribute__((always_inline))
+    static inline void BlockPerlin(FNvf& out, int seed, const FNvf& x, const FNvf& y)
+    {
+        FNvi x0, y0;
+        VecFloor(x0, x);
+        VecFloor(y0, y);
+
+        FNvf xd0 = x - __builtin_convertvector(x0, FNvf);
+        FNvf yd0 = y - __builtin_convertvector(y0, FNvf);
+        FNvf xd1 = xd0 - 1;
+        FNvf yd1 = yd0 - 1;
+
+        // InterpQuintic
+        FNvf xs = xd0 * xd0 * xd0 * (xd0 * (xd0 * 6 - 15) + 10);
+        FNvf ys = yd0 * yd0 * yd0 * (yd0 * (yd0 * 6 - 15) + 10);
+
+        VecMulPrime(x0, PrimeX);
+        VecMulPrime(y0, PrimeY);
+        FNvi x1 = x0 + PrimeX;
+        FNvi y1 = y0 + PrimeY;
+
+        // Lerp(a, b, t) = a + t * (b - a)
+        FNvf g0, g1;
+        VecGradCoord(g0, seed, x0, y0, xd0, yd0);
+        VecGradCoord(g1, seed, x1, y0, xd1, yd0);
+        FNvf xf0 = g0 + xs * (g1 - g0);
+        VecGradCoord(g0, seed, x0, y1, xd0, yd1);
+        VecGradCoord(g1, seed, x1, y1, xd1, yd1);
+        FNvf xf1 = g0 + xs * (g1 - g0);
+
+        out = (xf0 + ys * (xf1 - xf0)) * 1.4247691104677813f;
+    }
+
+    // gradient versions of the above, mirroring SingleSimplexGradient and
+    // SinglePerlinGradient
+
+    template <NoiseType Type>
+    __attribute__((target("avx2")))
+    size_t GenNoiseGradientSetAVX2(const float* xs, const float* ys, float* output, float* dxs, float* dys, size_t count)
+    {
+        return GenNoiseGradientSetBlocks<Type>(xs, ys, output, dxs, dys, count);
+    }
+
+    template <NoiseType Type>
+    __attribute__((target("sse4.1")))
+    size_t GenNoiseGradientSetSSE41(const float* xs, const float* ys, float* output, float* dxs, float* dys, size_t count)
+    {
+        return GenNoiseGradientSetBlocks<Type>(xs, ys, output, dxs, dys, count);
+    }
+
+    template <NoiseType Type>
+    __attribute__((always_inline))
+    inline size_t GenNoiseGradientSetBlocks(const float* xs, const float* ys, float* output, float* dxs, float* dys, size_t count)
+    {
+        const float SQRT3 = (float)1.7320508075688772935274463415059;
+        const float F2 = 0.5f * (SQRT3 - 1);
+
+        size_t i = 0;
+        for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH)
+        {
+            FNvf x, y, n, dx, dy;
+            memcpy(&x, xs + i, sizeof(x));
+            memcpy(&y, ys + i, sizeof(y));
+
+            x *= mFrequency;
+            y *= mFrequency;
+
+            if (Type == NoiseType_OpenSimplex2)
+            {
+                FNvf t = (x + y) * F2;
+                x += t;
+                y += t;
+                BlockSimplexGradient(n, dx, dy, mSeed, x, y);
+            }
+            else
+            {
+                BlockPerlinGradient(n, dx, dy, mSeed, x, y);
+            }
+
+            dx *= mFrequency;
+            dy *= mFrequency;
+            memcpy(output + i, &n, sizeof(n));
+            memcpy(dxs + i, &dx, sizeof(dx));
+            memcpy(dys + i, &dy, sizeof(dy));
+        }
+        return i;
+    }
+
+    __attribute__((always_inline))
+    static inline void VecGradVector(FNvf& xg, FNvf& yg, int seed, const FNvi& xPrimed, const FNvi& yPrimed)
+    {
+        FNvi hash = (FNvi)(((FNvu)(seed ^ xPrimed ^ yPrimed)) * 0x27d4eb2du);
+        hash ^= hash >> 15;
+        hash &= 127 << 1;
+
+        for (int l = 0; l < SIMD_WIDTH; l++)
+        {
+            xg[l] = Lookup<float>::Gradients2D[hash[l]];
+            yg[l] = Lookup<float>::Gradients2D[hash[l] | 1];
+        }
+    }
+
+    // SimplexCorner, zero where a <= 0
+    __attribute__((always_inline))
+    static inline void VecSimplexCorner(FNvf& n, FNvf& dx, FNvf& dy, int seed, const FNvi& xPrimed, const FNvi& yPrimed,
+                                        const FNvf& xd, const FNvf& yd, const FNvf& a)
+    {
+        const FNvf zero = {};
+        FNvf xg, yg;
+        VecGradVector(xg, yg, seed, xPrimed, yPrimed);
+        FNvf dot = xd * xg + yd * yg;
+
+        FNvf a4 = (a * a) * (a * a);
+        FNvf k = -8 * (a * a) * a * dot;
+        FNvi inside = (FNvi)(a > 0);
+        VecSelect(n, inside, a4 * dot, zero);
+        VecSelect(dx, inside, a4 * xg + k * xd, zero);
+        VecSelect(dy, inside, a4 * yg + k * yd, zero);
+    }
+
+    __attribute__((always_inline))
+    static inline void BlockSimplexGradient(FNvf& out, FNvf& dx, FNvf& dy, int seed, const FNvf& x, const FNvf& y)
+    {
+        const float SQRT3 = 1.7320508075688772935274463415059f;
+        const float G2 = (3 - SQRT3) / 6;
+        const float C1 = (float)(2 * (1 - 2 * G2) * (1 / G2 - 2));
+        const float C2 = (float)(-2 * (1 - 2 * G2) * (1 - 2 * G2));
+        const FNvf zero = {};
+
+        FNvi i, j;
+        VecFloor(i, x);
+        VecFloor(j, y);
+        FNvf xi = x - __builtin_convertvector(i, FNvf);
+        FNvf yi = y - __builtin_convertvector(j, FNvf);
+
+        FNvf t = (xi + yi) * G2;
+        FNvf x0 = xi - t;
+        FNvf y0 = yi - t;
+
+        VecMulPrime(i, PrimeX);
+        VecMulPrime(j, PrimeY);
+
+        FNvf n0, dx0, dy0;
+        FNvf a = 0.5f - x0 * x0 - y0 * y0;
+        VecSimplexCorner(n0, dx0, dy0, seed, i, j, x0, y0, a);
+
+        FNvf n2, dx2, dy2;
+        FNvf c = C1 * t + (C2 + a);
+        FNvf x2 = x0 + (2 * (float)G2 - 1);
+        FNvf y2 = y0 + (2 * (float)G2 - 1);
+        VecSimplexCorner(n2, dx2, dy2, seed, i + PrimeX, j + PrimeY, x2, y2, c);
+
+        FNvi upper = (FNvi)(y0 > x0);
+        FNvf x1, y1;
+        VecSelect(x1, upper, zero + (float)G2, zero + ((float)G2 - 1));
+        VecSelect(y1, upper, zero + ((float)G2 - 1), zero + (float)G2);
+        x1 += x0;
+        y1 += y0;
+        FNvi i1, j1;
+        VecSelect(i1, upper, i, i + PrimeX);
+        VecSelect(j1, upper, j + PrimeY, j);
+        FNvf n1, dx1, dy1;
+        FNvf b = 0.5f - x1 * x1 - y1 * y1;
+        VecSimplexCorner(n1, dx1, dy1, seed, i1, j1, x1, y1, b);
+
+        dx = (dx0 + dx1 + dx2) * 99.83685446303647f;
+        dy = (dy0 + dy1 + dy2) * 99.83685446303647f;
+        out = (n0 + n1 + n2) * 99.83685446303647f;
+    }
+
+    __attribute__((always_inline))
+    static inline void BlockPerlinGradient(FNvf& out, FNvf& dx, FNvf& dy, int seed, const FNvf& x, const FNvf& y)
+    {
+        FNvi x0, y0;
+        VecFloor(x0, x);
+        VecFloor(y0, y);
+
+        FNvf xd0 = x - __builtin_convertvector(x0, FNvf);
+        FNvf yd0 = y - __builtin_convertvector(y0, FNvf);
+        FNvf xd1 = xd0 - 1;
+        FNvf yd1 = yd0 - 1;
+
+        // InterpQuintic and InterpQuinticDerivative
+        FNvf xs = xd0 * xd0 * xd0 * (xd0 * (xd0 * 6 - 15) + 10);
+        FNvf ys = yd0 * yd0 * yd0 * (yd0 * (yd0 * 6 - 15) + 10);
+        FNvf dxs = xd0 * xd0 * (xd0 * (xd0 * 30 - 60) + 30);
+        FNvf dys = yd0 * yd0 * (yd0 * (yd0 * 30 - 60) + 30);
+
+        VecMulPrime(x0, PrimeX);
+        VecMulPrime(y0, PrimeY);
+        FNvi x1 = x0 + PrimeX;
+        FNvi y1 = y0 + PrimeY;
+
+        FNvf xg00, yg00, xg10, yg10, xg01, yg01, xg11, yg11;
+        VecGradVector(xg00, yg00, seed, x0, y0);
+        VecGradVector(xg10, yg10, seed, x1, y0);
+        VecGradVector(xg01, yg01, seed, x0, y1);
+        VecGradVector(xg11, yg11, seed, x1, y1);
+
+        FNvf v00 = xd0 * xg00 + yd0 * yg00;
+        FNvf v10 = xd1 * xg10 + yd0 * yg10;
+        FNvf v01 = xd0 * xg01 + yd1 * yg01;
+        FNvf v11 = xd1 * xg11 + yd1 * yg11;
+
+        // Lerp(a, b, t) = a + t * (b - a)
+        FNvf xf0 = v00 + xs * (v10 - v00);
+        FNvf xf1 = v01 + xs * (v11 - v01);
+
+        FNvf xf0dx = xg00 + xs * (xg10 - xg00) + dxs * (v10 - v00);
+        FNvf xf1dx = xg01 + xs * (xg11 - xg01) + dxs * (v11 - v01);
+        FNvf xf0dy = yg00 + xs * (yg10 - yg00);
+        FNvf xf1dy = yg01 + xs * (yg11 - yg01);
+
+        dx = (xf0dx + ys * (xf1dx - xf0dx)) * 1.4247691104677813f;
+        dy = (xf0dy + ys * (xf1dy - xf0dy) + dys * (xf1 - xf0)) * 1.4247691104677813f;
+        out = (xf0 + ys * (xf1 - xf0)) * 1.4247691104677813f;
+    }
+#endif
+
+
+    // Compile-time specialized noise gen
+    //
+    // Mirrors GenNoiseSingle, TransformNoiseCoordinate and the fractal
+    // functions with the switches on template arguments, which the
+    // compiler folds away.
+
+    template <NoiseType Type, typename FNfloat>
+    float GenNoiseSingleFixed(int seed, FNfloat x, FNfloat y)
+    {
+        switch (Type)
+        {
+        case NoiseType_OpenSimplex2:
+            return SingleSimplex(seed, x, y);
+        case NoiseType_OpenSimplex2S:
+            return SingleOpenSimplex2S(seed, x, y);
+        case NoiseType_Cellular:
+            return SingleCellular(seed, x, y);
+        case NoiseType_Perlin:
+            return SinglePerlin(seed, x, y);
+        case NoiseType_ValueCubic:
+            return SingleValueCubic(seed, x, y);
+        case NoiseType_Value:
+            return SingleValue(seed, x, y);
+        default:
+            return 0;
+        }
+    }
+
+    template <NoiseType Type, typename FNfloat>
+    void TransformNoiseCoordinateFixed(FNfloat& x, FNfloat& y)
+    {
+        x *= mFrequency;
+        y *= mFrequency;
+
+        if (Type == NoiseType_OpenSimplex2 || Type == NoiseType_OpenSimplex2S)
+        {
+            const FNfloat SQRT3 = (FNfloat)1.7320508075688772935274463415059;
+            const FNfloat F2 = 0.5f * (SQRT3 - 1);
+            FNfloat t = (x + y) * F2;
+            x += t;
+            y += t;
+        }
+    }
+
+    template <NoiseType Type, FractalType Fractal, int Octaves, typename FNfloat>
+    float GenFractalFixed(FNfloat x, FNfloat y)
+    {
+        if (Fractal != FractalType_FBm && Fractal != FractalType_Ridged && Fractal != FractalType_PingPong)
+            return GenNoiseSingleFixed<Type>(mSeed, x, y);
+
+        // CalculateFractalBounding for Octaves
+        float gain = FastAbs(mGain);
+        float bound = gain;
+        float ampFractal = 1.0f;
+        for (int i = 1; i < Octaves; i++)
+        {
+            ampFractal += bound;
+            bound *= gain;
+        }
+
+        int seed = mSeed;
+        float sum = 0;
+        float amp = 1 / ampFractal;
+
+        for (int i = 0; i < Octaves; i++)
+        {
+            float noise = GenNoiseSingleFixed<Type>(seed++, x, y);
+            switch (Fractal)
+            {
+            case FractalType_FBm:
+                sum += noise * amp;
+                amp *= Lerp(1.0f, FastMin(noise + 1, 2) * 0.5f, mWeightedStrength);
+                break;
+            case FractalType_Ridged:
+                noise = FastAbs(noise);
+                sum += (noise * -2 + 1) * amp;
+                amp *= Lerp(1.0f, 1 - noise, mWeightedStrength);
+                break;
+            default:
+                noise = PingPong((noise + 1) * mPingPongStrength);
+                sum += (noise - 0.5f) * 2 * amp;
+                amp *= Lerp(1.0f, noise, mWeightedStrength);
+                break;
+            }
+
+            x *= mLacunarity;
+            y *= mLacunarity;
+            amp *= mGain;
+        }
+
+        return sum;
+    }
+
+
     // Noise Coordinate Transforms (frequency, and possible skew or rotation)
 
     template <typename FNfloat>
@@ -862,6 +1604,45 @@ private:
         return sum;
     }
 
+    // GenFractalFBm and its gradient; the weighted strength makes each
+    // octave's amplitude depend on the previous noise, so the gradient of
+    // the amplitude is carried along
+    template <typename FNfloat>
+    float GenFractalFBmGradient(FNfloat x, FNfloat y, float& dx, float& dy)
+    {
+        int seed = mSeed;
+        float sum = 0;
+        float amp = mFractalBounding;
+        float ampDx = 0, ampDy = 0;
+        float scale = 1;
+        dx = dy = 0;
+
+        for (int i = 0; i < mOctaves; i++)
+        {
+            float ndx, ndy;
+            float noise = GenNoiseSingleGradient(seed++, x, y, ndx, ndy);
+            ndx *= scale;
+            ndy *= scale;
+
+            sum += noise * amp;
+            dx += ndx * amp + noise * ampDx;
+            dy += ndy * amp + noise * ampDy;
+
+            float weight = Lerp(1.0f, FastMin(noise + 1, 2) * 0.5f, mWeightedStrength);
+            float slope = noise + 1 < 2 ? 0.5f * mWeightedStrength : 0;
+            ampDx = (ampDx * weight + amp * slope * ndx) * mGain;
+            ampDy = (ampDy * weight + amp * slope * ndy) * mGain;
+            amp *= weight;
+
+            x *= mLacunarity;
+            y *= mLacunarity;
+            scale *= mLacunarity;
+            amp *= mGain;
+        }
+
+        return sum;
+    }
+
     template <typename FNfloat>
     float GenFractalFBm(FNfloat x, FNfloat y, FNfloat z)
     {
@@ -1791,6 +2572,135 @@ private:
         return Lerp(xf0, xf1, ys) * 1.4247691104677813f;
     }
 
+
+    // Noise gradients
+    //
+    // SingleSimplex and SinglePerlin, also returning the derivatives of
+    // the noise. The value is computed exactly as there.
+
+    template <typename FNfloat>
+    float SingleSimplexGradient(int seed, FNfloat x, FNfloat y, float& dx, float& dy)
+    {
+        const float SQRT3 = 1.7320508075688772935274463415059f;
+        const float G2 = (3 - SQRT3) / 6;
+
+        int i = FastFloor(x);
+        int j = FastFloor(y);
+        float xi = (float)(x - i);
+        float yi = (float)(y - j);
+
+        float t = (xi + yi) * G2;
+        float x0 = (float)(xi - t);
+        float y0 = (float)(yi - t);
+
+        i *= PrimeX;
+        j *= PrimeY;
+
+        // corner offsets are unskewed, so the derivatives along them are
+        // the derivatives along the coordinates before the skew
+        float n0 = 0, dx0 = 0, dy0 = 0;
+        float a = 0.5f - x0 * x0 - y0 * y0;
+        if (a > 0)
+        {
+            n0 = SimplexCorner(seed, i, j, x0, y0, a, dx0, dy0);
+        }
+
+        float n2 = 0, dx2 = 0, dy2 = 0;
+        float c = (float)(2 * (1 - 2 * G2) * (1 / G2 - 2)) * t + ((float)(-2 * (1 - 2 * G2) * (1 - 2 * G2)) + a);
+        if (c > 0)
+        {
+            float x2 = x0 + (2 * (float)G2 - 1);
+            float y2 = y0 + (2 * (float)G2 - 1);
+            n2 = SimplexCorner(seed, i + PrimeX, j + PrimeY, x2, y2, c, dx2, dy2);
+        }
+
+        float n1 = 0, dx1 = 0, dy1 = 0;
+        float x1, y1;
+        int i1, j1;
+        if (y0 > x0)
+        {
+            x1 = x0 + (float)G2;
+            y1 = y0 + ((float)G2 - 1);
+            i1 = i;
+            j1 = j + PrimeY;
+        }
+        else
+        {
+            x1 = x0 + ((float)G2 - 1);
+            y1 = y0 + (float)G2;
+            i1 = i + PrimeX;
+            j1 = j;
+        }
+        float b = 0.5f - x1 * x1 - y1 * y1;
+        if (b > 0)
+        {
+            n1 = SimplexCorner(seed, i1, j1, x1, y1, b, dx1, dy1);
+        }
+
+        dx = (dx0 + dx1 + dx2) * 99.83685446303647f;
+        dy = (dy0 + dy1 + dy2) * 99.83685446303647f;
+        return (n0 + n1 + n2) * 99.83685446303647f;
+    }
+
+    // a^4 (g . d) and its derivatives for the corner at offset d
+    float SimplexCorner(int seed, int xPrimed, int yPrimed, float xd, float yd, float a, float& dx, float& dy)
+    {
+        float xg, yg;
+        GradVector(seed, xPrimed, yPrimed, xg, yg);
+        float dot = xd * xg + yd * yg;
+
+        float a4 = (a * a) * (a * a);
+        float k = -8 * (a * a) * a * dot;
+        dx = a4 * xg + k * xd;
+        dy = a4 * yg + k * yd;
+        return a4 * dot;
+    }
+
+    template <typename FNfloat>
+    float SinglePerlinGradient(int seed, FNfloat x, FNfloat y, float& dx, float& dy)
+    {
+        int x0 = FastFloor(x);
+        int y0 = FastFloor(y);
+
+        float xd0 = (float)(x - x0);
+        float yd0 = (float)(y - y0);
+        float xd1 = xd0 - 1;
+        float yd1 = yd0 - 1;
+
+        float xs = InterpQuintic(xd0);
+        float ys = InterpQuintic(yd0);
+        float dxs = InterpQuinticDerivative(xd0);
+        float dys = InterpQuinticDerivative(yd0);
+
+        x0 *= PrimeX;
+        y0 *= PrimeY;
+        int x1 = x0 + PrimeX;
+        int y1 = y0 + PrimeY;
+
+        float xg00, yg00, xg10, yg10, xg01, yg01, xg11, yg11;
+        GradVector(seed, x0, y0, xg00, yg00);
+        GradVector(seed, x1, y0, xg10, yg10);
+        GradVector(seed, x0, y1, xg01, yg01);
+        GradVector(seed, x1, y1, xg11, yg11);
+
+        float v00 = xd0 * xg00 + yd0 * yg00;
+        float v10 = xd1 * xg10 + yd0 * yg10;
+        float v01 = xd0 * xg01 + yd1 * yg01;
+        float v11 = xd1 * xg11 + yd1 * yg11;
+
+        float xf0 = Lerp(v00, v10, xs);
+        float xf1 = Lerp(v01, v11, xs);
+
+        float xf0dx = Lerp(xg00, xg10, xs) + dxs * (v10 - v00);
+        float xf1dx = Lerp(xg01, xg11, xs) + dxs * (v11 - v01);
+        float xf0dy = Lerp(yg00, yg10, xs);
+        float xf1dy = Lerp(yg01, yg11, xs);
+
+        dx = Lerp(xf0dx, xf1dx, ys) * 1.4247691104677813f;
+        dy = (Lerp(xf0dy, xf1dy, ys) + dys * (xf1 - xf0)) * 1.4247691104677813f;
+        return Lerp(xf0, xf1, ys) * 1.4247691104677813f;
+    }
+
     template <typename FNfloat>
     float SinglePerlin(int seed, FNfloat x, FNfloat y, FNfloat z)
     {
@@ -0,0 +1,31 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glm/glm.hpp>
+
+#include <Light.h>
+
+// Per-frame camera and light state, laid out as the std140 "Frame" block
+// declared in the shaders (vec3s are padded to vec4).
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    glm::vec4 camera_position;
+
+    // light
+    glm::vec4 light_position;
+    glm::vec4 light_ambient;
+    glm::vec4 light_diffuse;
+    glm::vec4 light_specular;
+
+    void set_light(const Light& light)
+    {
+        light_position = glm::vec4(light.position, 1.0f);
+        light_ambient  = light.ambient;
+        light_diffuse  = light.diffuse;
+        light_specular = light.specular;
+    }
+};
+
+#endif // FRAME_UNIFORMS_H
@@ -0,0 +1,147 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include <Bounds.h>
+
+// View frustum as six planes (nx, ny, nz, d), normals pointing inwards,
+// extracted from a view-projection matrix (Gribb & Hartmann).
+class Frustum {
+public:
+    enum Plane {
+        PLANE_LEFT = 0,
+        PLANE_RIGHT,
+        PLANE_BOTTOM,
+        PLANE_TOP,
+        PLANE_NEAR,
+        PLANE_FAR,
+        NUMBER_OF_PLANES
+    };
+
+    enum Classification { OUTSIDE = 0, INTERSECTS, INSIDE };
+
+    Frustum()
+    {
+        // accepts everything
+        for (int i = 0; i < NUMBER_OF_PLANES; ++i)
+            _plane[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    Frustum(const glm::mat4& view_projection)
+    {
+        const glm::mat4& m = view_projection;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        _plane[PLANE_LEFT]   = row3 + row0;
+        _plane[PLANE_RIGHT]  = row3 - row0;
+        _plane[PLANE_BOTTOM] = row3 + row1;
+        _plane[PLANE_TOP]    = row3 - row1;
+        _plane[PLANE_NEAR]   = row3 + row2;
+        _plane[PLANE_FAR]    = row3 - row2;
+
+        for (int i = 0; i < NUMBER_OF_PLANES; ++i)
+            _plane[i] /= glm::length(glm::vec3(_plane[i]));
+    }
+
+    const glm::vec4& plane(int i) const
+    { return _plane[i]; }
+
+    // false if the box is completely outside one of the planes
+    bool intersects(const AABB& b) const
+    {
+        if (b.empty())
+            return false;
+
+        glm::vec3 c = b.center(), e = b.extent();
+        for (int i = 0; i < NUMBER_OF_PLANES; ++i) {
+            const glm::vec4& p = _plane[i];
+            float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            float r = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+            if (d + r < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // whether the box is completely outside, completely inside or
+    // crossing the frustum boundary
+    Classification classify(const AABB& b) const
+    {
+        if (b.empty())
+            return OUTSIDE;
+
+        glm::vec3 c = b.center(), e = b.extent();
+        Classification result = INSIDE;
+        for (int i = 0; i < NUMBER_OF_PLANES; ++i) {
+            const glm::vec4& p = _plane[i];
+            float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            float r = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+            if (d + r < 0.0f)
+                return OUTSIDE;
+            if (d - r < 0.0f)
+                result = INTERSECTS;
+        }
+        return result;
+    }
+
+    // test every box of the array, 4 at a time with SSE;
+    // visible[i] is set to 1 if box i intersects the frustum, 0 otherwise
+    void cull(const AABBArray& boxes, std::vector<uint8_t>& visible) const
+    {
+        size_t n = boxes.size();
+        visible.resize(n);
+
+        size_t i = 0;
+#ifdef FRUSTUM_SSE
+        __m128 zero = _mm_setzero_ps();
+        __m128 sign = _mm_set1_ps(-0.0f);
+        for (; i + 4 <= n; i += 4) {
+            __m128 cx = _mm_loadu_ps(&boxes.cx[i]);
+            __m128 cy = _mm_loadu_ps(&boxes.cy[i]);
+            __m128 cz = _mm_loadu_ps(&boxes.cz[i]);
+            __m128 ex = _mm_loadu_ps(&boxes.ex[i]);
+            __m128 ey = _mm_loadu_ps(&boxes.ey[i]);
+            __m128 ez = _mm_loadu_ps(&boxes.ez[i]);
+
+            // lanes that are outside of any plane
+            __m128 outside = _mm_setzero_ps();
+            for (int k = 0; k < NUMBER_OF_PLANES; ++k) {
+                const glm::vec4& p = _plane[k];
+                __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z);
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                      _mm_add_ps(_mm_mul_ps(pz, cz), _mm_set1_ps(p.w)));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, px), ex),
+                                                 _mm_mul_ps(_mm_andnot_ps(sign, py), ey)),
+                                      _mm_mul_ps(_mm_andnot_ps(sign, pz), ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            visible[i + 0] = !(mask & 1);
+            visible[i + 1] = !(mask & 2);
+            visible[i + 2] = !(mask & 4);
+            visible[i + 3] = !(mask & 8);
+        }
+#endif
+        // remaining boxes (or all of them without SSE)
+        for (; i < n; ++i)
+            visible[i] = intersects(boxes.get(i)) ? 1 : 0;
+    }
+
+private:
+    glm::vec4 _plane[NUMBER_OF_PLANES];
+};
+#endif // FRUSTUM_H
@@ -0,0 +1,314 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <Vertex.h>
+
+// vertices and indices per page; larger meshes get a page of their own
+#define GEOMETRY_PAGE_VERTICES (1 << 18)
+#define GEOMETRY_PAGE_INDICES  (1 << 20)
+
+// Per-draw data read through instanced vertex attributes: the model
+// matrix (locations 3 to 6), the normal matrix (8 to 10, columns padded to
+// vec4) and the material table index of the draw (7)
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 normal[3];
+    GLint     material;
+    GLint     padding[3];
+
+    void set_normal_matrix(const glm::mat3& n)
+    {
+        normal[0] = glm::vec4(n[0], 0.0f);
+        normal[1] = glm::vec4(n[1], 0.0f);
+        normal[2] = glm::vec4(n[2], 0.0f);
+    }
+};
+
+// matrix transforming normals under model matrix m
+static inline glm::mat3
+normal_matrix(const glm::mat4& m)
+{ return glm::transpose(glm::inverse(glm::mat3(m))); }
+
+// Where a mesh lives inside the geometry pool
+struct GeometryAllocation {
+    int    page;
+    GLuint base_vertex;
+    GLuint vertex_count;
+    GLuint first_index;  // in indices of index_type
+    GLuint index_count;
+    GLenum index_type;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+// smallest index type able to address vertex_count vertices; indices are
+// relative to the mesh base vertex, so only the mesh size matters
+static inline GLenum
+index_type_for(size_t vertex_count)
+{ return vertex_count <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+static inline GLuint
+index_size(GLenum type)
+{ return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+// First-fit allocator of [offset, offset + size) ranges with coalescing
+class RangeAllocator {
+public:
+    RangeAllocator(GLuint capacity = 0)
+    {
+        if (capacity > 0)
+            _free[0] = capacity;
+    }
+
+    bool allocate(GLuint size, GLuint& offset)
+    {
+        // empty ranges take no room
+        if (size == 0) {
+            offset = 0;
+            return true;
+        }
+
+        for (std::map<GLuint, GLuint>::iterator it = _free.begin(); it != _free.end(); ++it) {
+            if (it->second < size)
+                continue;
+
+            offset = it->first;
+            GLuint left = it->second - size;
+            _free.erase(it);
+            if (left > 0)
+                _free[offset + size] = left;
+            return true;
+        }
+        return false;
+    }
+
+    void release(GLuint offset, GLuint size)
+    {
+        if (size == 0)
+            return;
+
+        std::map<GLuint, GLuint>::iterator next = _free.lower_bound(offset);
+
+        // merge with the following free range
+        if (next != _free.end() && offset + size == next->first) {
+            size += next->second;
+            next = _free.erase(next);
+        }
+        // and with the preceding one
+        if (next != _free.begin()) {
+            std::map<GLuint, GLuint>::iterator prev = next;
+            --prev;
+            if (prev->first + prev->second == offset) {
+                prev->second += size;
+                return;
+            }
+        }
+        _free[offset] = size;
+    }
+
+private:
+    std::map<GLuint, GLuint> _free; // offset -> size
+};
+
+// A large vertex buffer and index buffer sharing one VAO. All indices of a
+// page have the same type, so a page can be drawn with one multi-draw call.
+class GeometryPage {
+public:
+    GeometryPage(GLuint vertex_capacity, GLuint index_capacity, GLenum index_type)
+        : _vertices(vertex_capacity), _indices(index_capacity)
+    {
+        _instance_vbo = 0;
+        _index_type   = index_type;
+
+        glGenVertexArrays(1, &_vao);
+        glBindVertexArray(_vao);
+
+        glGenBuffers(1, &_vbo);
+        glGenBuffers(1, &_ebo);
+
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertex_capacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity * index_size(index_type), NULL, GL_STATIC_DRAW);
+
+        // set the vertex attribute pointers
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+        // vertex Normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // Texture Coordinates
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TextureCoords));
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ~GeometryPage()
+    {
+        glDeleteVertexArrays(1, &_vao);
+        glDeleteBuffers(1, &_vbo);
+        glDeleteBuffers(1, &_ebo);
+    }
+
+    GeometryPage(const GeometryPage&) = delete;
+    GeometryPage& operator=(const GeometryPage&) = delete;
+
+    GLuint vao() { return _vao; }
+
+    GLenum index_type() { return _index_type; }
+
+    // copy a mesh into the page; false if it does not fit. An empty mesh
+    // (a chunk with no exposed sides) takes no room and uploads nothing
+    bool allocate(const std::vector<Vertex>& vertices, const std::vector<Face>& faces,
+                  GeometryAllocation& a)
+    {
+        a.vertex_count = vertices.size();
+        a.index_count  = 3 * faces.size();
+        a.index_type   = _index_type;
+
+        if (!_vertices.allocate(a.vertex_count, a.base_vertex))
+            return false;
+        if (!_indices.allocate(a.index_count, a.first_index)) {
+            _vertices.release(a.base_vertex, a.vertex_count);
+            return false;
+        }
+
+        // indices stay relative to the mesh, draws pass base_vertex
+        if (!vertices.empty()) {
+            glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, a.base_vertex * sizeof(Vertex),
+                            vertices.size() * sizeof(Vertex), vertices.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (faces.empty())
+            return true;
+
+        glBindVertexArray(_vao);
+        if (_index_type == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> indices(a.index_count);
+            for (size_t i = 0; i < faces.size(); ++i) {
+                indices[3 * i + 0] = faces[i].Index.x;
+                indices[3 * i + 1] = faces[i].Index.y;
+                indices[3 * i + 2] = faces[i].Index.z;
+            }
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, a.first_index * sizeof(GLushort),
+                            indices.size() * sizeof(GLushort), indices.data());
+        } else {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, a.first_index * sizeof(GLuint),
+                            faces.size() * sizeof(Face), faces.data());
+        }
+        glBindVertexArray(0);
+        return true;
+    }
+
+    void release(const GeometryAllocation& a)
+    {
+        _vertices.release(a.base_vertex, a.vertex_count);
+        _indices.release(a.first_index, a.index_count);
+    }
+
+    // point the per-instance attributes at instance_vbo, starting at
+    // byte offset; expects the VAO to be bound
+    void bind_instance_buffer(GLuint instance_vbo, size_t offset = 0)
+    {
+        if (_instance_vbo == instance_vbo && offset == 0)
+            return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        // model matrix, one column per location
+        for (GLuint i = 0; i < 4; ++i) {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(offset + offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        // normal matrix
+        for (GLuint i = 0; i < 3; ++i) {
+            glEnableVertexAttribArray(8 + i);
+            glVertexAttribPointer(8 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(offset + offsetof(InstanceData, normal) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(8 + i, 1);
+        }
+        // material index
+        glEnableVertexAttribArray(7);
+        glVertexAttribIPointer(7, 1, GL_INT, sizeof(InstanceData),
+            (void*)(offset + offsetof(InstanceData, material)));
+        glVertexAttribDivisor(7, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // only the plain binding is remembered
+        _instance_vbo = offset == 0 ? instance_vbo : 0;
+    }
+
+private:
+    GLuint         _vao;
+    GLuint         _vbo, _ebo;
+    GLuint         _instance_vbo; // instance buffer wired into _vao at offset 0
+    GLenum         _index_type;
+    RangeAllocator _vertices;
+    RangeAllocator _indices;
+};
+
+// All static mesh geometry, sub-allocated from a few large pages so that
+// draws sharing a page (and a texture) can go out in one multi-draw call.
+class GeometryPool {
+public:
+    // the pool shared by all meshes; never destroyed, as meshes of global
+    // objects give their geometry back after function statics are gone
+    static GeometryPool& instance()
+    {
+        static GeometryPool* pool = new GeometryPool;
+        return *pool;
+    }
+
+    GeometryAllocation allocate(const std::vector<Vertex>& vertices, const std::vector<Face>& faces)
+    {
+        GeometryAllocation a;
+        GLenum type = index_type_for(vertices.size());
+        for (size_t i = 0; i < _pages.size(); ++i) {
+            if (_pages[i]->index_type() == type && _pages[i]->allocate(vertices, faces, a)) {
+                a.page = i;
+                return a;
+            }
+        }
+
+        // new page, big enough for this mesh
+        GLuint nv = std::max<GLuint>(GEOMETRY_PAGE_VERTICES, vertices.size());
+        GLuint ni = std::max<GLuint>(GEOMETRY_PAGE_INDICES, 3 * faces.size());
+        _pages.push_back(std::unique_ptr<GeometryPage>(new GeometryPage(nv, ni, type)));
+        _pages.back()->allocate(vertices, faces, a);
+        a.page = _pages.size() - 1;
+        return a;
+    }
+
+    void release(const GeometryAllocation& a)
+    { _pages[a.page]->release(a); }
+
+    GeometryPage& page(int i)
+    { return *_pages[i]; }
+
+    // delete the pages while the context is still there, once every mesh
+    // is gone
+    void release()
+    { _pages.clear(); }
+
+    size_t number_of_pages()
+    { return _pages.size(); }
+
+private:
+    GeometryPool()
+    { }
+
+    std::vector<std::unique_ptr<GeometryPage> > _pages;
+};
+#endif // GEOMETRY_POOL_H
@@ -0,0 +1,214 @@
+#ifndef HEIGHTFIELD_TERRAIN_H
+#define HEIGHTFIELD_TERRAIN_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cstddef>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <Material.h>
+#include <MaterialTable.h>
+#include <Shader.h>
+#include <MeshResource.h>
+#include <Model.h> // and stb_image
+
+// world size of a heightfield cell (a block is 2 units wide)
+#define HEIGHTFIELD_CELL 2.0f
+
+// Block terrain drawn straight from a heightmap: the heights are uploaded
+// as a single channel float texture and one instanced draw puts a block on
+// every cell, the vertex shader reading the block's height from the
+// texture. The CPU cost of a frame is one draw call whatever the size of
+// the map, and changing the terrain is one texture write. Given the normals
+// of the smooth surface through the heights, the tops of the blocks are
+// lit with them instead of the flat normal of the block.
+class HeightfieldTerrain {
+public:
+    HeightfieldTerrain()
+        : _vao(0), _vbo(0), _heights(0), _normals(0), _smooth(false), _width(0), _depth(0), _x(0), _z(0),
+          _material(0)
+    { _block.id = 0; }
+
+    ~HeightfieldTerrain()
+    { release(); }
+
+    HeightfieldTerrain(const HeightfieldTerrain&) = delete;
+    HeightfieldTerrain& operator=(const HeightfieldTerrain&) = delete;
+
+    // program, block texture (an unfolded cube of 3 x 4 tiles, as the
+    // ChunkMesher takes) and block material
+    void load(const char* vspath, const char* fspath, const char* texture_path, const Material& material)
+    {
+        _shader = Shader(vspath, fspath);
+        _shader.activate();
+        glUniform1i(_shader.location(Shader::UNIFORM_SAMPLER), 0);
+        glUniform1i(_shader.location("vHeights"), 1);
+        glUniform1i(_shader.location("vNormals"), 2);
+        glUniform1f(_shader.location("vCell"), HEIGHTFIELD_CELL);
+        _material = MaterialTable::instance().add(material);
+
+        int channels;
+        stbi_set_flip_vertically_on_load(true);
+        _block.data = stbi_load(texture_path, &_block.width, &_block.height, &channels, 3);
+        if (_block.data == NULL) {
+            std::cout << "Failed to load texture " << texture_path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        upload_texture(_block);
+        stbi_image_free(_block.data);
+        _block.data = NULL;
+
+        _create_block();
+    }
+
+    // heightmap of width x depth cells, row by row, whose first cell is
+    // cell (x_offset, z_offset) of the world, and if not NULL the unit
+    // normal (x, y, z) of the surface at each cell, as Terrain::generate
+    // gives them
+    void set_heights(const float* heights, int width, int depth, int x_offset, int z_offset,
+                     const float* normals = NULL)
+    {
+        bool resized = width != _width || depth != _depth;
+        _write_texture(_heights, GL_R32F, GL_RED, heights, width, depth, resized);
+        _smooth = normals != NULL;
+        if (_smooth) {
+            _write_texture(_normals, GL_RGB32F, GL_RGB, normals, width, depth, resized);
+        } else if (_normals) {
+            glDeleteTextures(1, &_normals);
+            _normals = 0;
+        }
+
+        _width = width;
+        _depth = depth;
+        _x = x_offset;
+        _z = z_offset;
+    }
+
+    // delete the GL objects while the context is still there
+    void release()
+    {
+        if (_vao)
+            glDeleteVertexArrays(1, &_vao);
+        if (_vbo)
+            glDeleteBuffers(1, &_vbo);
+        if (_heights)
+            glDeleteTextures(1, &_heights);
+        if (_normals)
+            glDeleteTextures(1, &_normals);
+        if (_block.id)
+            glDeleteTextures(1, &_block.id);
+        _vao = _vbo = _heights = _normals = _block.id = 0;
+        _width = _depth = 0;
+    }
+
+    void render()
+    {
+        if (_width == 0 || _vao == 0)
+            return;
+
+        _shader.activate();
+        glUniform2i(_shader.location("vOrigin"), _x, _z);
+        glUniform1i(_shader.location("vMaterial"), _material);
+        glUniform1i(_shader.location("vSmooth"), _smooth);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, _normals);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, _heights);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _block.id);
+
+        glBindVertexArray(_vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, _width * _depth);
+        glBindVertexArray(0);
+    }
+
+private:
+    // writes width x depth texels of the given format to texture t, made
+    // on first use; allocated again if the size changed
+    static void _write_texture(GLuint& t, GLint internal_format, GLenum format, const float* data,
+                               int width, int depth, bool resized)
+    {
+        if (t == 0) {
+            glGenTextures(1, &t);
+            glBindTexture(GL_TEXTURE_2D, t);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            resized = true;
+        } else {
+            glBindTexture(GL_TEXTURE_2D, t);
+        }
+
+        if (resized)
+            glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, depth, 0, format, GL_FLOAT, data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, depth, format, GL_FLOAT, data);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // block of HEIGHTFIELD_CELL units centered on the origin in x and z
+    // and standing on it, like the grass block asset, each face
+    // textured with its tile: top (1, 2), sides (1, 1) and bottom (1, 0),
+    // rows counted from the bottom of the flipped image
+    void _create_block()
+    {
+        static const float corner[6][4][3] = {
+            { { -1,  1,  1 }, {  1,  1,  1 }, {  1,  1, -1 }, { -1,  1, -1 } }, // top
+            { { -1, -1, -1 }, {  1, -1, -1 }, {  1, -1,  1 }, { -1, -1,  1 } }, // bottom
+            { { -1, -1,  1 }, {  1, -1,  1 }, {  1,  1,  1 }, { -1,  1,  1 } }, // +z
+            { {  1, -1, -1 }, { -1, -1, -1 }, { -1,  1, -1 }, {  1,  1, -1 } }, // -z
+            { {  1, -1,  1 }, {  1, -1, -1 }, {  1,  1, -1 }, {  1,  1,  1 } }, // +x
+            { { -1, -1, -1 }, { -1, -1,  1 }, { -1,  1,  1 }, { -1,  1, -1 } }, // -x
+        };
+        static const float normal[6][3] = {
+            { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { -1, 0, 0 },
+        };
+        static const int row[6] = { 2, 0, 1, 1, 1, 1 };
+        static const float uv[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        static const int triangles[6] = { 0, 1, 2, 0, 2, 3 };
+
+        Vertex vertices[36];
+        for (int f = 0; f < 6; ++f) {
+            for (int k = 0; k < 6; ++k) {
+                int c = triangles[k];
+                Vertex& v = vertices[f * 6 + k];
+                v.Position = glm::vec3(corner[f][c][0], corner[f][c][1], corner[f][c][2]) * (0.5f * HEIGHTFIELD_CELL)
+                             + glm::vec3(0, 0.5f * HEIGHTFIELD_CELL, 0);
+                v.Normal = glm::vec3(normal[f][0], normal[f][1], normal[f][2]);
+                v.TextureCoords = glm::vec2((1.0f + uv[c][0]) / 3.0f, (row[f] + uv[c][1]) / 4.0f);
+            }
+        }
+
+        glGenVertexArrays(1, &_vao);
+        glGenBuffers(1, &_vbo);
+        glBindVertexArray(_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TextureCoords));
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    Shader   _shader;
+    Texture  _block;
+    GLuint   _vao, _vbo;
+    GLuint   _heights;          // GL_R32F texture, one texel per cell
+    GLuint   _normals;          // GL_RGB32F texture, one texel per cell
+    bool     _smooth;           // whether the tops use _normals
+    int      _width, _depth;    // cells
+    int      _x, _z;            // world cell of the first one
+    GLint    _material;
+};
+
+#endif
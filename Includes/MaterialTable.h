@@ -0,0 +1,96 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+
+#include <Material.h>
+#include <UniformBuffer.h>
+
+// must match MAX_MATERIALS in the shaders; 256 std140 materials fill the
+// 16KB uniform block size every GL implementation guarantees
+#define MAX_MATERIALS 256
+
+// Every material in use, packed into one uniform buffer ("Materials" block)
+// and selected in the shaders by index. Meshes register their material
+// once when it is set; the buffer is re-uploaded only when a new material
+// shows up.
+class MaterialTable {
+public:
+    // the table shared by all meshes; never destroyed, like the
+    // GeometryPool, so it outlives the meshes of global objects
+    static MaterialTable& instance()
+    {
+        static MaterialTable* table = new MaterialTable;
+        return *table;
+    }
+
+    // index of material m, adding it to the table if it is new
+    GLint add(const Material& m)
+    {
+        for (size_t i = 0; i < _count; ++i) {
+            if (_equal(_materials[i], m))
+                return i;
+        }
+
+        if (_count == MAX_MATERIALS) {
+            std::cerr << "Material table is full (" << MAX_MATERIALS << " materials)" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        GPUMaterial g = { m.ambient, m.diffuse, m.specular,
+                          glm::vec4(m.shininess, 0.0f, 0.0f, 0.0f) };
+        _materials[_count] = g;
+        _dirty = true;
+        return _count++;
+    }
+
+    size_t number_of_materials()
+    { return _count; }
+
+    // upload pending materials and bind the table to its binding point
+    void update()
+    {
+        // always upload the whole array so the buffer covers the block size
+        if (_dirty) {
+            _buffer.update(&_materials[0], _materials.size() * sizeof(GPUMaterial));
+            _dirty = false;
+        }
+    }
+
+    // delete the uniform buffer while the context is still there
+    void release()
+    {
+        _buffer.release();
+        _dirty = true;
+    }
+
+private:
+    MaterialTable()
+        : _materials(MAX_MATERIALS), _count(0),
+          _buffer(MATERIAL_BLOCK_BINDING), _dirty(false)
+    { }
+
+    // std140 layout of one Material array element
+    struct GPUMaterial {
+        glm::vec4 ambient;
+        glm::vec4 diffuse;
+        glm::vec4 specular;
+        glm::vec4 shininess; // x: shininess, yzw: padding
+    };
+
+    static bool _equal(const GPUMaterial& g, const Material& m)
+    {
+        return g.ambient == m.ambient && g.diffuse == m.diffuse &&
+               g.specular == m.specular && g.shininess.x == m.shininess;
+    }
+
+    std::vector<GPUMaterial> _materials;
+    size_t                   _count;
+    UniformBuffer            _buffer;
+    bool                     _dirty;
+};
+#endif // MATERIAL_TABLE_H
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include <GL/glew.h> // holds all OpenGL type declarations
 
@@ -10,27 +11,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <Material.h>
+#include <MaterialTable.h>
+#include <MeshResource.h>
 #include <Shader.h>
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texture coordinates
-    glm::vec2 TextureCoords;
-};
-
-// triangular face
-struct Face {
-    glm::uvec3 Index;
-};
-
-struct Texture {
-    GLuint         id;
-    int            width, height;
-    unsigned char *data;
-};
+#include <RenderQueue.h>
+#include <Transform.h>
 
 class Mesh {
 public:
@@ -39,120 +24,116 @@ public:
         Material &material, Texture &texture)
     {
         _material = material;
-        _texture  = texture;
-        _vertices = vertices;
-        _faces    = faces;
-        _matrix   = glm::mat4(1.0f);
+        _material_index = MaterialTable::instance().add(material);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        _setup_for_rendering();
+        _resource = std::make_shared<MeshResource>(std::move(vertices), std::move(faces), texture);
     }
 
-    // render the mesh
-    void render(Shader &shader, glm::mat4& global)
+    // share the geometry and GL buffers of an existing mesh
+    Mesh(std::shared_ptr<MeshResource> resource, Material &material)
     {
-        // pass material to vertex shader
-        glUniform4fv(glGetUniformLocation(shader.id(), "material.ambient"), 1,
-            glm::value_ptr(_material.ambient));
-        glUniform4fv(glGetUniformLocation(shader.id(), "material.diffuse"), 1,
-            glm::value_ptr(_material.diffuse));
-        glUniform4fv(glGetUniformLocation(shader.id(), "material.specular"), 1,
-            glm::value_ptr(_material.specular));
-        glUniform1f(glGetUniformLocation(shader.id(), "material.shininess"),
-            _material.shininess);
-        
-        // concatenate global and local model matrices
-        glm::mat4 m = global*_matrix;
-        glUniformMatrix4fv(glGetUniformLocation(shader.id(), "model"), 1, GL_FALSE, glm::value_ptr(m));
-        
-        glBindVertexArray(_vao);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.id(), "fSampler"), 0);
-        
-        glBindTexture(GL_TEXTURE_2D, _texture.id);
-        glDrawElements(GL_TRIANGLES, _faces.size() * sizeof(Face), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        _material = material;
+        _material_index = MaterialTable::instance().add(material);
+        _resource = resource;
     }
-    
+
+    // queue the mesh for rendering; parent is the model transform
+    void render(RenderQueue &queue, Shader &shader, Transform& parent)
+    {
+        DrawPacket p = _packet(shader);
+
+        // cached concatenation of global and local model matrices
+        p.matrix = _transform.world(parent);
+        p.normal = _transform.normal();
+        queue.push(p);
+    }
+
+    // queue the mesh to be drawn once per instance matrix; parent is an
+    // identity transform, instance matrices are applied on top of the
+    // local mesh matrix
+    void render_instanced(RenderQueue &queue, Shader &shader, Transform& parent,
+                          const glm::mat4 *instances, const glm::mat3 *normals, GLsizei count)
+    {
+        DrawPacket p = _packet(shader);
+        p.matrix         = _transform.world(parent);
+        p.normal         = _transform.normal();
+        p.instances      = instances;
+        p.normals        = normals;
+        p.instance_count = count;
+        queue.push(p);
+    }
+
     void set_material(Material &m)
     {
         _material = m;
+        _material_index = MaterialTable::instance().add(m);
     }
+
+    Material& material()
+    { return _material; }
+
+    GLint material_index()
+    { return _material_index; }
     
-    void set_matrix(glm::mat4& m)
+    void set_matrix(const glm::mat4& m)
     {
-        _matrix = m;
+        _transform.set_local(m);
     }
+
+    // local mesh matrix
+    const glm::mat4& matrix()
+    { return _transform.local(); }
+
+    // world matrix under the model transform parent
+    const glm::mat4& world_matrix(Transform& parent)
+    { return _transform.world(parent); }
+
+    Transform& transform()
+    { return _transform; }
+
+    // bounding box of the vertices, before the local mesh matrix
+    const AABB& bounds()
+    { return _resource->bounds(); }
+
+    // named point, before the local mesh matrix
+    const glm::vec3& pivot(Pivot p)
+    { return _resource->pivot(p); }
     
     Vertex& vertex(GLuint i)
-    { return _vertices[i]; }
+    { return _resource->vertex(i); }
     
     size_t number_of_vertices()
-    { return _vertices.size(); }
+    { return _resource->number_of_vertices(); }
+
+    std::shared_ptr<MeshResource> resource()
+    { return _resource; }
 
 
 private:
-    // initializes all the buffer objects/arrays
-    void _setup_for_rendering()
+    DrawPacket _packet(Shader &shader)
     {
-        // create vertex array object
-        glGenVertexArrays(1, &_vao);
-        glBindVertexArray(_vao);
-        
-        // create vertices and faces buffers
-        glGenBuffers(1, &_vbo);
-        glGenBuffers(1, &_ebo);
-        
-        // load data into vertex buffer
-        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), &_vertices[0], GL_STATIC_DRAW);
-
-        // load data into element buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _faces.size() * sizeof(Face), &_faces[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-        // vertex Normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TextureCoords));
-
-        glBindVertexArray(0);
-        
-        // Setup texture object
-        glGenTextures(1, &(_texture.id));
-        glBindTexture(GL_TEXTURE_2D, _texture.id);
-                
-        // set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _texture.width, _texture.height, 0, GL_RGB, GL_UNSIGNED_BYTE, _texture.data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-         
-        glBindTexture(GL_TEXTURE_2D, 0);
+        const GeometryAllocation& g = _resource->geometry();
+
+        DrawPacket p;
+        p.shader         = &shader;
+        p.page           = g.page;
+        p.vao            = _resource->vao();
+        p.texture        = _resource->texture_id();
+        p.count          = g.index_count;
+        p.first_index    = g.first_index;
+        p.base_vertex    = g.base_vertex;
+        p.material_index = _material_index;
+        p.instances      = NULL;
+        p.normals        = NULL;
+        p.instance_count = 0;
+        return p;
     }
-    
+
     // mesh Data
-    Material            _material;
-    Texture             _texture;
-    glm::mat4           _matrix;
-    std::vector<Vertex> _vertices;
-    std::vector<Face>   _faces;
-
-    // render data
-    GLuint _vao;
-    GLuint _vbo, _ebo;
+    Material                      _material;
+    GLint                         _material_index; // slot in MaterialTable
+    Transform                     _transform;
+    std::shared_ptr<MeshResource> _resource;
 };
 #endif
@@ -0,0 +1,140 @@
+#ifndef MESH_RESOURCE_H
+#define MESH_RESOURCE_H
+
+#include <vector>
+
+#include <GL/glew.h> // holds all OpenGL type declarations
+
+#include <glm/glm.hpp>
+
+#include <Vertex.h>
+#include <Bounds.h>
+#include <GeometryPool.h>
+
+struct Texture {
+    GLuint         id;
+    int            width, height;
+    unsigned char *data;
+};
+
+// creates the GL texture object of t from its pixels
+static inline void
+upload_texture(Texture& t)
+{
+    glGenTextures(1, &(t.id));
+    glBindTexture(GL_TEXTURE_2D, t.id);
+
+    // set the texture wrapping/filtering options (on the currently bound texture object)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t.width, t.height, 0, GL_RGB, GL_UNSIGNED_BYTE, t.data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Named points of a mesh, derived from its bounding box
+enum Pivot {
+    PIVOT_CENTER = 0,
+    PIVOT_TOP_CENTER,    // center of the top (max y) face
+    PIVOT_BOTTOM_CENTER, // center of the bottom (min y) face
+    NUMBER_OF_PIVOTS
+};
+
+// Geometry, GL buffers and texture of a mesh. A resource is owned through
+// std::shared_ptr by every Mesh drawing it, so copying a Model only copies
+// pointers; the GL objects are released when the last Mesh goes away.
+// Vertices and indices are stored in the shared GeometryPool.
+class MeshResource {
+public:
+    MeshResource(std::vector<Vertex> vertices, std::vector<Face> faces,
+        Texture &texture)
+        : _vertices(std::move(vertices)), _faces(std::move(faces)), _texture(texture)
+    {
+        // bounds and pivots are computed once, here
+        if (!_vertices.empty())
+            _bounds = AABB::of_points(&_vertices[0].Position, _vertices.size(), sizeof(Vertex));
+        glm::vec3 c = _bounds.center();
+        _pivot[PIVOT_CENTER]        = c;
+        _pivot[PIVOT_TOP_CENTER]    = glm::vec3(c.x, _bounds.max.y, c.z);
+        _pivot[PIVOT_BOTTOM_CENTER] = glm::vec3(c.x, _bounds.min.y, c.z);
+
+        _setup_for_rendering();
+    }
+
+    ~MeshResource()
+    {
+        GeometryPool::instance().release(_geometry);
+        if (_owns_texture)
+            glDeleteTextures(1, &(_texture.id));
+    }
+
+    // GL objects must have exactly one owner
+    MeshResource(const MeshResource&) = delete;
+    MeshResource& operator=(const MeshResource&) = delete;
+
+    // Access
+    GLuint texture_id() { return _texture.id; }
+
+    // location of vertices and indices in the geometry pool
+    const GeometryAllocation& geometry()
+    { return _geometry; }
+
+    GLuint vao()
+    { return GeometryPool::instance().page(_geometry.page).vao(); }
+
+    Vertex& vertex(GLuint i)
+    { return _vertices[i]; }
+
+    size_t number_of_vertices()
+    { return _vertices.size(); }
+
+    size_t number_of_faces()
+    { return _faces.size(); }
+
+    // index count and type recorded when the mesh was uploaded
+    GLuint number_of_indices()
+    { return _geometry.index_count; }
+
+    GLenum index_type()
+    { return _geometry.index_type; }
+
+    // bounding box of the vertices, in mesh coordinates
+    const AABB& bounds()
+    { return _bounds; }
+
+    // named point, in mesh coordinates
+    const glm::vec3& pivot(Pivot p)
+    { return _pivot[p]; }
+
+private:
+    // initializes the geometry and texture objects
+    void _setup_for_rendering()
+    {
+        // copy vertices and faces into the shared geometry buffers
+        _geometry = GeometryPool::instance().allocate(_vertices, _faces);
+        
+        // a texture that already has a GL object is shared, not owned
+        _owns_texture = _texture.id == 0;
+        if (_owns_texture)
+            upload_texture(_texture);
+
+        // pixels are owned (and freed) by the loader
+        _texture.data = NULL;
+    }
+
+    // mesh Data
+    std::vector<Vertex> _vertices;
+    std::vector<Face>   _faces;
+    Texture             _texture;
+    bool                _owns_texture;
+    AABB                _bounds;
+    glm::vec3           _pivot[NUMBER_OF_PIVOTS];
+
+    // render data
+    GeometryAllocation  _geometry;
+};
+#endif // MESH_RESOURCE_H
@@ -13,6 +13,9 @@
 #include <stb_image.h>
 
 #include <Mesh.h>
+#include <Bounds.h>
+#include <Frustum.h>
+#include <Transform.h>
 
 // some useful casting functions
 static glm::vec4
@@ -30,44 +33,246 @@ uvec3_cast(const unsigned int* f) { return glm::uvec3(f[0], f[1], f[2]); }
 static glm::vec2
 vec2_cast(const aiVector3D &v) { return glm::vec2(v.x, v.y); }
 
+// Phong material of an imported material
+static Material
+material_cast(const aiMaterial* mMaterial)
+{
+    aiColor3D ambient, diffuse, specular;
+    GLfloat shininess, opacity;
+
+    mMaterial->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
+    mMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+    mMaterial->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+    mMaterial->Get(AI_MATKEY_SHININESS, shininess);
+    mMaterial->Get(AI_MATKEY_OPACITY, opacity);
+
+    Material material = {
+        vec4_cast(ambient, opacity),
+        vec4_cast(diffuse, opacity),
+        vec4_cast(specular, opacity),
+        shininess };
+    return material;
+}
+
+// material of the first mesh of the model file at path, read without
+// loading the model
+static Material
+load_material(const char *path)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_ValidateDataStructure);
+    if (!scene || scene->mNumMeshes == 0) {
+        std::cout << "Failed to load material of " << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return material_cast(scene->mMaterials[scene->mMeshes[0]->mMaterialIndex]);
+}
+
 class Model
 {
 public:
     Model()
     {
-        _matrix   = glm::mat4(1.0f);
+        _instance_bounds_dirty = true;
+        _revision = 0;
+        _occluder = false;
+        _bounds_key = 0;
+        _bounds_valid = false;
     }
 
     Model(std::vector<Vertex> vertices, std::vector<Face> faces,
         Material &material, Texture &texture)
     {
         _mesh.push_back(Mesh(vertices, faces, material, texture));
-        _matrix   = glm::mat4(1.0f);
+        _instance_bounds_dirty = true;
+        _revision = 0;
+        _occluder = false;
+        _bounds_key = 0;
+        _bounds_valid = false;
     }
 
     Model(const char *path)
     {
         load_model(path);
-        _matrix = glm::mat4(1.0f);
+        _instance_bounds_dirty = true;
+        _revision = 0;
+        _occluder = false;
+        _bounds_key = 0;
+        _bounds_valid = false;
     }
     
-    void render(Shader &shader)
+    // queue every mesh of the model that intersects the frustum
+    void render(RenderQueue &queue, Shader &shader, const Frustum &frustum)
     {
+        if (!_instances.empty()) {
+            _render_instanced(queue, shader, frustum);
+            return;
+        }
+
         for (unsigned int i = 0; i < _mesh.size(); i++) {
+            const glm::mat4& m = _mesh[i].world_matrix(_transform);
+            if (!frustum.intersects(_mesh[i].bounds().transformed(m)))
+                continue;
+
             // apply global model matrix
-            _mesh[i].render(shader, _matrix);
+            _mesh[i].render(queue, shader, _transform);
+        }
+    }
+
+    // bounding box of all meshes (with their local matrices applied),
+    // before the global model matrix; recomputed only when a mesh moved
+    const AABB& bounds()
+    {
+        unsigned int key = mesh_version();
+        if (!_bounds_valid || key != _bounds_key) {
+            _bounds = AABB();
+            for (unsigned int i = 0; i < _mesh.size(); i++)
+                _bounds.expand(_mesh[i].bounds().transformed(_mesh[i].matrix()));
+            _bounds_key = key;
+            _bounds_valid = true;
+        }
+        return _bounds;
+    }
+
+    // bounding box after the global model matrix
+    AABB world_bounds()
+    { return bounds().transformed(_transform.world()); }
+
+    // a model is an occluder when its meshes fill their bounding boxes
+    // (like blocks), so the boxes can hide what is behind them
+    void set_occluder(bool occluder)
+    { _occluder = occluder; _occluder_bounds = AABB(); }
+
+    // an occluder whose solid part is only box, in model coordinates
+    void set_occluder(const AABB& box)
+    { _occluder = true; _occluder_bounds = box; }
+
+    // world box hiding what is behind it, for a model drawn without instances
+    AABB occluder_bounds()
+    {
+        if (_occluder_bounds.empty())
+            return world_bounds();
+        return _occluder_bounds.transformed(_transform.world());
+    }
+
+    bool is_occluder()
+    { return _occluder; }
+
+    // bumped whenever the model or one of its instances is moved
+    unsigned int revision()
+    { return _revision; }
+
+    // changes whenever a mesh is added or its local matrix is set
+    unsigned int mesh_version()
+    {
+        unsigned int version = _mesh.size();
+        for (unsigned int i = 0; i < _mesh.size(); i++)
+            version += _mesh[i].transform().local_version();
+        return version;
+    }
+
+    // Instancing: once a model has instances it is drawn once per instance
+    // matrix with a single instanced draw per mesh, and the global model
+    // matrix is ignored.
+    void add_instance(const glm::mat4& m)
+    {
+        if (_instances.empty())
+            _invalidate_meshes();
+        _instances.push_back(m);
+        _instance_normals.push_back(normal_matrix(m));
+        _instance_bounds_dirty = true;
+        _revision++;
+    }
+
+    void set_instance_matrix(unsigned int i, const glm::mat4& m)
+    {
+        _instances[i] = m;
+        _instance_normals[i] = normal_matrix(m);
+        if (!_instance_bounds_dirty)
+            _instance_bounds.set(i, _instance_local_bounds.transformed(m));
+        _visible_mask.clear(); // rebuild the visible list on next render
+        _revision++;
+    }
+
+    const glm::mat4& instance_matrix(unsigned int i)
+    { return _instances[i]; }
+
+    void clear_instances()
+    {
+        _invalidate_meshes();
+        _instances.clear();
+        _instance_normals.clear();
+        _instance_bounds_dirty = true;
+        _revision++;
+    }
+
+    size_t number_of_instances()
+    { return _instances.size(); }
+
+    // world bounds of every instance, rebuilt when instances were added
+    // or removed or a mesh matrix changed the model bounds; returns true
+    // if they were rebuilt
+    bool update_instance_bounds()
+    {
+        AABB local = bounds();
+        if (!_instance_bounds_dirty && local == _instance_local_bounds)
+            return false;
+
+        _instance_local_bounds = local;
+        _instance_bounds.clear();
+        for (size_t i = 0; i < _instances.size(); ++i)
+            _instance_bounds.push_back(local.transformed(_instances[i]));
+        _instance_bounds_dirty = false;
+        _visible_mask.clear();
+        return true;
+    }
+
+    // world bounds of instance i (see update_instance_bounds)
+    AABB instance_bounds(unsigned int i)
+    { return _instance_bounds.get(i); }
+
+    // queue the instances flagged in visible (one flag per instance)
+    void render_instances(RenderQueue &queue, Shader &shader, const std::vector<uint8_t> &visible)
+    {
+        if (visible != _visible_mask) {
+            _visible_mask = visible;
+            _visible.clear();
+            _visible_normals.clear();
+            for (size_t i = 0; i < _instances.size(); ++i) {
+                if (_visible_mask[i]) {
+                    _visible.push_back(_instances[i]);
+                    _visible_normals.push_back(_instance_normals[i]);
+                }
+            }
+        }
+
+        if (_visible.empty())
+            return;
+
+        for (unsigned int i = 0; i < _mesh.size(); i++) {
+            _mesh[i].render_instanced(queue, shader, _instance_root, &_visible[0], &_visible_normals[0], _visible.size());
         }
     }
     
-    void set_matrix(glm::mat4& m)
+    void set_matrix(const glm::mat4& m)
     {
-        _matrix = m;
+        _transform.set_local(m);
+        _revision++;
     }
 
-    glm::mat4& matrix(){
-        return _matrix;
+    const glm::mat4& matrix(){
+        return _transform.local();
     }
+
+    Transform& transform()
+    { return _transform; }
     
+    void add_mesh(const Mesh& mesh)
+    {
+        _mesh.push_back(mesh);
+        _bounds_valid = false;
+    }
+
     size_t number_of_meshes()
     { return _mesh.size(); }
     
@@ -77,6 +282,23 @@ public:
     }
 
 private:
+    // meshes switch parents between the model transform and the instance
+    // root; make them recompute their world matrices
+    void _invalidate_meshes()
+    {
+        for (unsigned int i = 0; i < _mesh.size(); i++)
+            _mesh[i].transform().invalidate();
+    }
+
+    void _render_instanced(RenderQueue &queue, Shader &shader, const Frustum &frustum)
+    {
+        update_instance_bounds();
+
+        // only instances inside the frustum go to the instance buffer
+        frustum.cull(_instance_bounds, _cull_mask);
+        render_instances(queue, shader, _cull_mask);
+    }
+
     void load_model(const char *path)
     {
         // Create an instance of the Importer class
@@ -140,20 +362,7 @@ private:
             
             // Get mesh material (always suppose Phong illumination model)            
             const aiMaterial* mMaterial = scene->mMaterials[mMesh->mMaterialIndex];
-            aiColor3D ambient, diffuse, specular;
-            GLfloat shininess, opacity;
-            
-            mMaterial->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
-            mMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
-            mMaterial->Get(AI_MATKEY_COLOR_SPECULAR, specular);
-            mMaterial->Get(AI_MATKEY_SHININESS, shininess);
-            mMaterial->Get(AI_MATKEY_OPACITY, opacity);
-            
-            Material material = {
-                vec4_cast(ambient, opacity),
-                vec4_cast(diffuse, opacity),
-                vec4_cast(specular, opacity),
-                shininess };
+            Material material = material_cast(mMaterial);
                 
             // Diffuse texture map (assuming only one map #0)
             Texture texture = {0, -1, -1, NULL};
@@ -178,14 +387,38 @@ private:
             
             _mesh.push_back(Mesh(vertices, faces, material, texture));
             
+            // vertices/faces were copied into the mesh resource
             vertices.clear();
             faces.clear();
             stbi_image_free(texture.data);
         }
     }
 
-    std::vector<Mesh> _mesh;
-    glm::mat4         _matrix;
+    std::vector<Mesh>      _mesh;
+    Transform              _transform;     // global model matrix
+    Transform              _instance_root; // identity parent of instanced meshes
+
+    // cached model bounds
+    AABB                   _bounds;
+    unsigned int           _bounds_key;
+    bool                   _bounds_valid;
+
+    // instance data
+    std::vector<glm::mat4> _instances;
+    std::vector<glm::mat3> _instance_normals; // normal matrix of each instance
+
+    // instance culling
+    AABB                   _instance_local_bounds;
+    AABBArray              _instance_bounds;
+    bool                   _instance_bounds_dirty;
+    std::vector<uint8_t>   _cull_mask;
+    std::vector<uint8_t>   _visible_mask;
+    std::vector<glm::mat4> _visible;
+    std::vector<glm::mat3> _visible_normals;
+
+    unsigned int           _revision;
+    bool                   _occluder;
+    AABB                   _occluder_bounds; // empty: the whole model
 };
 
 #endif // MODEL_H
@@ -0,0 +1,259 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include <Bounds.h>
+
+// CPU occlusion culling. Occluders (boxes known to be solid) are
+// rasterized into a small depth buffer, a max-depth pyramid is built over
+// it, and candidate boxes are tested against the pyramid level where they
+// cover only a few texels. Everything runs on the CPU, so it works the same
+// on software GL implementations.
+//
+// Every step is conservative: an occluder is written only to the texels its
+// silhouette covers entirely, at the farthest depth of the box, occluders
+// crossing the near plane are skipped, and any box that can not be
+// projected safely is reported visible.
+class OcclusionCuller {
+public:
+    OcclusionCuller(int width = 128, int height = 128)
+    {
+        // multiple of 4 wide, for the SSE rasterizer
+        _width  = (width + 3) & ~3;
+        _height = height;
+    }
+
+    // start a new frame seen from eye through view_projection
+    void begin(const glm::mat4& view_projection, const glm::vec3& eye)
+    {
+        _view_projection = view_projection;
+        _eye = eye;
+
+        _depth.assign(_width * _height, 1.0f);
+        _levels.clear();
+    }
+
+    // rasterize the silhouette of a solid box
+    void add_occluder(const AABB& b)
+    {
+        glm::vec3 s[8];
+        float z = 0.0f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 p((i & 1) ? b.max.x : b.min.x,
+                        (i & 2) ? b.max.y : b.min.y,
+                        (i & 4) ? b.max.z : b.min.z);
+            if (!_project(p, s[i]))
+                return; // crosses the near plane
+            z = std::max(z, s[i].z);
+        }
+
+        // the box hides the convex hull of its corners on screen; drawing
+        // it whole leaves no seams between faces
+        glm::vec3 hull[16];
+        int n = _convex_hull(s, hull);
+        if (n >= 3)
+            _rasterize(hull, n, z);
+    }
+
+    // build the depth pyramid; call after the last occluder
+    void finish()
+    {
+        _levels.clear();
+        _levels.push_back(Level());
+        _levels[0].width  = _width;
+        _levels[0].height = _height;
+        _levels[0].depth  = _depth;
+
+        while (_levels.back().width > 1 || _levels.back().height > 1) {
+            const Level& src = _levels.back();
+            Level dst;
+            dst.width  = std::max(1, src.width  / 2);
+            dst.height = std::max(1, src.height / 2);
+            dst.depth.resize(dst.width * dst.height);
+
+            for (int y = 0; y < dst.height; ++y) {
+                int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; ++x) {
+                    int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    dst.depth[y * dst.width + x] = std::max(
+                        std::max(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+                        std::max(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1]));
+                }
+            }
+            _levels.push_back(dst);
+        }
+    }
+
+    // false only if the box is certainly hidden behind the occluders
+    bool visible(const AABB& b)
+    {
+        if (_levels.empty())
+            return true;
+
+        float xmin = 1e30f, ymin = 1e30f, xmax = -1e30f, ymax = -1e30f, zmin = 1.0f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 p((i & 1) ? b.max.x : b.min.x,
+                        (i & 2) ? b.max.y : b.min.y,
+                        (i & 4) ? b.max.z : b.min.z);
+            glm::vec3 s;
+            if (!_project(p, s))
+                return true;
+            xmin = std::min(xmin, s.x); xmax = std::max(xmax, s.x);
+            ymin = std::min(ymin, s.y); ymax = std::max(ymax, s.y);
+            zmin = std::min(zmin, s.z);
+        }
+
+        int x0 = std::max(0, (int)std::floor(xmin)), x1 = std::min(_width  - 1, (int)std::floor(xmax));
+        int y0 = std::max(0, (int)std::floor(ymin)), y1 = std::min(_height - 1, (int)std::floor(ymax));
+        if (x0 > x1 || y0 > y1)
+            return true; // off screen, leave it to frustum culling
+
+        // coarsest level where the rectangle covers at most 2x2 texels
+        int level = 0;
+        while (level + 1 < (int)_levels.size() && ((x1 >> level) - (x0 >> level) > 1 ||
+                                                   (y1 >> level) - (y0 >> level) > 1))
+            level++;
+
+        const Level& l = _levels[level];
+        for (int y = y0 >> level; y <= std::min(y1 >> level, l.height - 1); ++y) {
+            for (int x = x0 >> level; x <= std::min(x1 >> level, l.width - 1); ++x) {
+                if (zmin <= l.depth[y * l.width + x])
+                    return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Level {
+        int width, height;
+        std::vector<float> depth;
+    };
+
+    // screen coordinates in depth buffer pixels, depth in [0,1]; false if
+    // the point is behind (or too close to) the eye
+    bool _project(const glm::vec3& p, glm::vec3& s)
+    {
+        glm::vec4 c = _view_projection * glm::vec4(p, 1.0f);
+        if (c.w < 1e-3f)
+            return false;
+        float inv = 1.0f / c.w;
+        s = glm::vec3((c.x * inv * 0.5f + 0.5f) * _width,
+                      (c.y * inv * 0.5f + 0.5f) * _height,
+                      c.z * inv * 0.5f + 0.5f);
+        return true;
+    }
+
+    // counter-clockwise convex hull of the 8 points p (Andrew's monotone
+    // chain); returns its number of points, hull needs room for 16
+    static int _convex_hull(const glm::vec3* p, glm::vec3* hull)
+    {
+        glm::vec3 s[8];
+        std::copy(p, p + 8, s);
+        std::sort(s, s + 8, [](const glm::vec3& a, const glm::vec3& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+
+        int n = 0;
+        for (int i = 0; i < 8; ++i) {           // lower chain
+            while (n >= 2 && _turn(hull[n - 2], hull[n - 1], s[i]) <= 0.0f)
+                n--;
+            hull[n++] = s[i];
+        }
+        for (int i = 6, lower = n + 1; i >= 0; --i) { // upper chain
+            while (n >= lower && _turn(hull[n - 2], hull[n - 1], s[i]) <= 0.0f)
+                n--;
+            hull[n++] = s[i];
+        }
+        return n - 1; // the first point closes the chain
+    }
+
+    // positive if a, b, c turn counter-clockwise
+    static float _turn(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    { return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x); }
+
+    // fill at depth z the texels entirely inside a counter-clockwise convex
+    // screen space polygon of n <= 8 vertices
+    void _rasterize(const glm::vec3* v, int n, float z)
+    {
+        if (z < 0.0f || z > 1.0f)
+            return;
+
+        float xmin = v[0].x, xmax = v[0].x, ymin = v[0].y, ymax = v[0].y;
+        for (int i = 1; i < n; ++i) {
+            xmin = std::min(xmin, v[i].x); xmax = std::max(xmax, v[i].x);
+            ymin = std::min(ymin, v[i].y); ymax = std::max(ymax, v[i].y);
+        }
+        int x0 = std::max(0, (int)std::floor(xmin)), x1 = std::min(_width - 1, (int)std::ceil(xmax));
+        int y0 = std::max(0, (int)std::floor(ymin)), y1 = std::min(_height - 1, (int)std::ceil(ymax));
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        // edge functions e(p) = a*(p.y - v.y) - b*(p.x - v.x), positive
+        // inside; over a texel e varies by (|a| + |b|)/2 around its value at
+        // the center, so the texel is entirely inside when e(center) >= r
+        float a[8], b[8], r[8];
+        for (int i = 0; i < n; ++i) {
+            const glm::vec3& w = v[(i + 1) % n];
+            a[i] = w.x - v[i].x;
+            b[i] = w.y - v[i].y;
+            r[i] = 0.5f * (std::fabs(a[i]) + std::fabs(b[i]));
+        }
+
+#ifdef OCCLUSION_SSE
+        x0 &= ~3;
+        __m128 all = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+        __m128 depth = _mm_set1_ps(z);
+        __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            float* row = &_depth[y * _width];
+
+            for (int x = x0; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                __m128 inside = all;
+                for (int i = 0; i < n; ++i) {
+                    __m128 e = _mm_sub_ps(_mm_set1_ps(a[i] * (py - v[i].y)),
+                                          _mm_mul_ps(_mm_set1_ps(b[i]), _mm_sub_ps(px, _mm_set1_ps(v[i].x))));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(e, _mm_set1_ps(r[i])));
+                }
+
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 closer = _mm_min_ps(old, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            for (int x = x0; x <= x1; ++x) {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (int i = 0; i < n && inside; ++i)
+                    inside = a[i] * (py - v[i].y) - b[i] * (px - v[i].x) >= r[i];
+                if (inside) {
+                    float& d = _depth[y * _width + x];
+                    d = std::min(d, z);
+                }
+            }
+        }
+#endif
+    }
+
+    int                _width, _height;
+    glm::mat4          _view_projection;
+    glm::vec3          _eye;
+    std::vector<float> _depth;
+    std::vector<Level> _levels;
+};
+#endif // OCCLUSION_CULLER_H
@@ -0,0 +1,291 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <GeometryPool.h>
+#include <Shader.h>
+
+// Everything needed to issue one draw call
+struct DrawPacket {
+    Shader*          shader;
+    int              page;           // geometry pool page
+    GLuint           vao;            // VAO of the page
+    GLuint           texture;
+    GLuint           count;          // number of indices
+    GLuint           first_index;
+    GLuint           base_vertex;
+    GLint            material_index;
+    glm::mat4        matrix;         // model matrix (local mesh matrix when instanced)
+    glm::mat3        normal;         // normal matrix of matrix
+    const glm::mat4* instances;      // instance matrices, NULL for non-instanced draws
+    const glm::mat3* normals;        // normal matrices of the instances
+    GLsizei          instance_count;
+};
+
+// Layout of GL_DRAW_INDIRECT_BUFFER commands
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint base_instance;
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit key
+//
+//   | program (8) | texture (16) | vao (16) | depth (24) |
+//
+// and submits them in that order. The model matrix and material of every
+// draw (or instance) are written to one per-frame instance buffer, and each
+// run of draws sharing program, texture and geometry page goes out as a
+// single glMultiDrawElementsIndirect. Depth is the view space distance, so
+// draws sharing the same state are issued front to back.
+class RenderQueue {
+public:
+    RenderQueue()
+        : _instance_vbo(0), _indirect_buffer(0)
+    { }
+
+    ~RenderQueue()
+    { release(); }
+
+    // delete the GL buffers while the context is still there
+    void release()
+    {
+        if (_instance_vbo != 0)
+            glDeleteBuffers(1, &_instance_vbo);
+        if (_indirect_buffer != 0)
+            glDeleteBuffers(1, &_indirect_buffer);
+        _instance_vbo = 0;
+        _indirect_buffer = 0;
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // start a new frame seen through the given view matrix
+    void begin(const glm::mat4& view)
+    {
+        _view = view;
+        _packets.clear();
+        _keys.clear();
+    }
+
+    void push(const DrawPacket& p)
+    {
+        uint64_t depth = 0;
+        if (p.instances == NULL) {
+            glm::vec4 center = _view * p.matrix[3];
+            depth = _depth_bits(-center.z);
+        }
+
+        uint64_t key = ((uint64_t)(p.shader->id() & 0xff)  << 56) |
+                       ((uint64_t)(p.texture      & 0xffff) << 40) |
+                       ((uint64_t)(p.vao          & 0xffff) << 24) |
+                       depth;
+
+        SortItem item = { key, (uint32_t)_packets.size() };
+        _keys.push_back(item);
+        _packets.push_back(p);
+    }
+
+    size_t number_of_packets()
+    { return _packets.size(); }
+
+    // radix sort the packets by key
+    void sort()
+    {
+        size_t n = _keys.size();
+        _scratch.resize(n);
+
+        SortItem* src = _keys.data();
+        SortItem* dst = _scratch.data();
+
+        // least significant byte first, one counting pass per byte
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t count[256] = {0};
+            for (size_t i = 0; i < n; ++i)
+                count[(src[i].key >> shift) & 0xff]++;
+
+            // every key has the same byte: this pass would not move anything
+            if (n == 0 || count[(src[0].key >> shift) & 0xff] == n)
+                continue;
+
+            size_t offset = 0;
+            for (int b = 0; b < 256; ++b) {
+                size_t c = count[b];
+                count[b] = offset;
+                offset += c;
+            }
+
+            for (size_t i = 0; i < n; ++i)
+                dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+
+            std::swap(src, dst);
+        }
+
+        if (src != _keys.data())
+            std::memcpy(_keys.data(), src, n * sizeof(SortItem));
+    }
+
+    // issue every packet in key order
+    void submit()
+    {
+        if (_keys.empty())
+            return;
+
+        _build_commands();
+
+        Shader* shader  = NULL;
+        GLuint  vao     = 0;
+        GLuint  texture = 0;
+
+        glActiveTexture(GL_TEXTURE0);
+
+        size_t i = 0;
+        while (i < _keys.size()) {
+            DrawPacket& p = _packets[_keys[i].index];
+
+            // run of draws sharing all state
+            size_t end = i + 1;
+            while (end < _keys.size()) {
+                DrawPacket& q = _packets[_keys[end].index];
+                if (q.shader != p.shader || q.vao != p.vao || q.texture != p.texture)
+                    break;
+                end++;
+            }
+
+            if (p.shader != shader) {
+                shader = p.shader;
+                shader->activate();
+            }
+            if (p.vao != vao) {
+                vao = p.vao;
+                glBindVertexArray(vao);
+                GeometryPool::instance().page(p.page).bind_instance_buffer(_instance_vbo);
+            }
+            if (p.texture != texture) {
+                texture = p.texture;
+                glBindTexture(GL_TEXTURE_2D, texture);
+            }
+
+            _draw(GeometryPool::instance().page(p.page), i, end - i);
+            i = end;
+        }
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+private:
+    struct SortItem {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // top 24 bits of a non-negative float; IEEE 754 bit patterns of
+    // positive floats sort like the floats themselves
+    static uint64_t _depth_bits(float d)
+    {
+        if (!(d > 0.0f))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits >> 8;
+    }
+
+    // fill and upload the instance data and indirect commands, in key order
+    void _build_commands()
+    {
+        _instances.clear();
+        _commands.clear();
+
+        for (size_t i = 0; i < _keys.size(); ++i) {
+            DrawPacket& p = _packets[_keys[i].index];
+
+            DrawElementsIndirectCommand c;
+            c.count          = p.count;
+            c.instance_count = p.instances ? p.instance_count : 1;
+            c.first_index    = p.first_index;
+            c.base_vertex    = p.base_vertex;
+            c.base_instance  = _instances.size();
+            _commands.push_back(c);
+
+            // normal matrices come cached with the packet instead of being
+            // computed per vertex in the shader; for instances the cached
+            // instance normal matrix is combined with the local one
+            InstanceData d;
+            d.material = p.material_index;
+            if (p.instances == NULL) {
+                d.model = p.matrix;
+                d.set_normal_matrix(p.normal);
+                _instances.push_back(d);
+            } else {
+                for (GLsizei k = 0; k < p.instance_count; ++k) {
+                    d.model = p.instances[k] * p.matrix;
+                    d.set_normal_matrix(p.normals[k] * p.normal);
+                    _instances.push_back(d);
+                }
+            }
+        }
+
+        if (_instance_vbo == 0)
+            glGenBuffers(1, &_instance_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, _instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, _instances.size() * sizeof(InstanceData), &_instances[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (GLEW_ARB_multi_draw_indirect) {
+            if (_indirect_buffer == 0)
+                glGenBuffers(1, &_indirect_buffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, _commands.size() * sizeof(DrawElementsIndirectCommand),
+                         &_commands[0], GL_STREAM_DRAW);
+        }
+    }
+
+    // draw commands [first, first + count) of the current run
+    void _draw(GeometryPage& page, size_t first, size_t count)
+    {
+        if (GLEW_ARB_multi_draw_indirect) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, page.index_type(),
+                (void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+            return;
+        }
+
+        // no indirect draws: one call per command
+        for (size_t i = first; i < first + count; ++i) {
+            const DrawElementsIndirectCommand& c = _commands[i];
+            void* indices = (void*)((size_t)c.first_index * index_size(page.index_type()));
+
+            if (GLEW_ARB_base_instance) {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, c.count, page.index_type(),
+                    indices, c.instance_count, c.base_vertex, c.base_instance);
+            } else {
+                // move the instance attributes to the first instance instead
+                page.bind_instance_buffer(_instance_vbo, c.base_instance * sizeof(InstanceData));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, page.index_type(),
+                    indices, c.instance_count, c.base_vertex);
+            }
+        }
+    }
+
+    glm::mat4                                _view;
+    std::vector<DrawPacket>                  _packets;
+    std::vector<SortItem>                    _keys;
+    std::vector<SortItem>                    _scratch;
+
+    // per-frame GPU data
+    std::vector<InstanceData>                _instances;
+    std::vector<DrawElementsIndirectCommand> _commands;
+    GLuint                                   _instance_vbo;
+    GLuint                                   _indirect_buffer;
+};
+#endif // RENDER_QUEUE_H
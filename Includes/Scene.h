@@ -10,92 +10,399 @@
 #include <Projection.h>
 #include <View.h>
 #include <Light.h>
+#include <FrameUniforms.h>
+#include <UniformBuffer.h>
 #include <Shader.h>
+#include <MaterialTable.h>
+#include <RenderQueue.h>
+#include <Frustum.h>
+#include <BVH.h>
+#include <OcclusionCuller.h>
 #include <Model.h>
 
+// at most this many of the closest occluders are rasterized per frame
+#define MAX_OCCLUDERS 256
+
+// Something the scene spatial index refers to: a whole model, or one
+// instance of an instanced model
+struct SceneItem {
+    unsigned int model;
+    int          instance; // -1 for the whole model
+};
+
 class Scene
 {
 public:
     Scene()
-    { _width = 400; _height = 400; }
+        : _frame_buffer(FRAME_BLOCK_BINDING)
+    { _width = 400; _height = 400; _frame_dirty = true; _bvh_dirty = true; _occlusion_culling = true; }
 
     Scene(GLuint w, GLuint h)
-        : _width(w), _height(h)
-    { }
+        : _width(w), _height(h), _frame_buffer(FRAME_BLOCK_BINDING)
+    { _frame_dirty = true; _bvh_dirty = true; _occlusion_culling = true; }
 
     void set_projection(GLfloat fov, GLfloat aspect, GLfloat near, GLfloat far)
-    { _projection = Projection(fov, aspect, near, far); }
+    { _projection = Projection(fov, aspect, near, far); _frame_dirty = true; }
     
     void set_projection(GLfloat xmin, GLfloat xmax, GLfloat ymin, GLfloat ymax,
                         GLfloat zmin, GLfloat zmax)
-    { _projection = Projection(xmin, xmax, ymin, ymax, zmin, zmax); }
+    { _projection = Projection(xmin, xmax, ymin, ymax, zmin, zmax); _frame_dirty = true; }
 
     void set_view(glm::vec3 eye, glm::vec3 at, glm::vec3 up)
-    { _view = View(eye,at,up); }
+    { _view = View(eye,at,up); _frame_dirty = true; }
 
     void set_light(glm::vec3 position,
                   glm::vec4 ambient, glm::vec4 diffuse, glm::vec4 specular)
-    { _light = Light {position, ambient, diffuse, specular}; }
+    { _light = Light {position, ambient, diffuse, specular}; _frame_dirty = true; }
     
     void set_light(Light light)
-    { _light = light; }
+    { _light = light; _frame_dirty = true; }
+
+    // hide models and instances behind occluders (see Model::set_occluder)
+    void set_occlusion_culling(bool enabled)
+    { _occlusion_culling = enabled; }
 
     void set_shader(const char* vspath, const char* fspath)
-    { _shader = Shader(vspath, fspath); }
+    {
+        _shader = Shader(vspath, fspath);
+
+        // textures are always bound to unit 0
+        _shader.activate();
+        glUniform1i(_shader.location(Shader::UNIFORM_SAMPLER), 0);
+    }
     
     void render()
     {      
-        glUniformMatrix4fv(glGetUniformLocation(_shader.id(), "view"), 1, GL_FALSE, glm::value_ptr(_view.get_matrix()));
-        glUniformMatrix4fv(glGetUniformLocation(_shader.id(), "projection"), 1, GL_FALSE, glm::value_ptr(_projection.get_matrix()));
-        
-        // pass light to vertex shader
-        glUniform3fv(glGetUniformLocation(_shader.id(), "light.position"), 1,
-            glm::value_ptr(_light.position));
-        glUniform4fv(glGetUniformLocation(_shader.id(), "light.ambient"), 1,
-            glm::value_ptr(_light.ambient));
-        glUniform4fv(glGetUniformLocation(_shader.id(), "light.diffuse"), 1,
-            glm::value_ptr(_light.diffuse));
-        glUniform4fv(glGetUniformLocation(_shader.id(), "light.specular"), 1,
-            glm::value_ptr(_light.specular));
-
         _shader.activate();
+
+        // camera and light only go to the GPU when they changed
+        if (_frame_dirty) {
+            _update_frame_uniforms();
+            _frame_dirty = false;
+        }
+        MaterialTable::instance().update();
+
+        // collect, sort and submit the draws of this frame
+        // skipping everything outside the view frustum
+        glm::mat4 view_projection = _projection.get_matrix() * _view.get_matrix();
+        Frustum frustum(view_projection);
+        _update_bvh();
+        _visible.clear();
+        _bvh.query(frustum, _visible);
+
+        // and everything hidden behind occluders
+        if (_occlusion_culling)
+            _cull_occluded(view_projection);
+
         for (int i = 0; i < _model.size(); ++i) {
-            _model[i].render(_shader);
+            _model_visible[i] = 0;
+            _instance_visible[i].assign(_model[i].number_of_instances(), 0);
+        }
+        for (size_t i = 0; i < _visible.size(); ++i) {
+            const SceneItem& item = _items[_visible[i]];
+            if (item.instance < 0)
+                _model_visible[item.model] = 1;
+            else
+                _instance_visible[item.model][item.instance] = 1;
         }
+
+        _queue.begin(_view.get_matrix());
+        for (int i = 0; i < _model.size(); ++i) {
+            if (_model[i].number_of_instances() > 0)
+                _model[i].render_instances(_queue, _shader, _instance_visible[i]);
+            else if (_model_visible[i])
+                _model[i].render(_queue, _shader, frustum);
+        }
+        _queue.sort();
+        _queue.submit();
     }
     
-    void add_model(std::vector<Vertex> vertices, std::vector<Face> faces,
+    // Models are numbered by their slot, which they keep until removed.
+    // A new model takes the slot of a removed one when there is one, and
+    // its leaf of the spatial index is refitted; only new slots rebuild
+    // the index. Each add_model returns the slot of the model.
+    unsigned int add_model(std::vector<Vertex> vertices, std::vector<Face> faces,
         Material &material, Texture &texture)
     {
-        _model.push_back(Model(vertices, faces, material, texture));
+        return add_model(Model(vertices, faces, material, texture));
     }
     
-    void add_model(const char *path)
+    unsigned int add_model(const char *path)
     {
-        _model.push_back(Model(path));
+        return add_model(Model(path));
     }
 
-    void add_model(Model model)
+    unsigned int add_model(const Model& model)
     {
+        if (!_free.empty()) {
+            unsigned int i = _free.back();
+            _free.pop_back();
+            set_model(i, model);
+            return i;
+        }
         _model.push_back(model);
+        _bvh_dirty = true;
+        return _model.size() - 1;
+    }
+
+    // delete every model and GL object of the scene; call before the GL
+    // context is destroyed
+    void release()
+    {
+        _model.clear();
+        _free.clear();
+        _queue.release();
+        _frame_buffer.release();
+        _frame_dirty = true;
+        _bvh_dirty = true;
+    }
+
+    // free slot i; the other models keep theirs
+    void remove_model(unsigned int i)
+    {
+        set_model(i, Model());
+        _free.push_back(i);
     }
     
+    // add one more copy of model i, drawn with instancing
+    void add_instance(unsigned int i, const glm::mat4& m)
+    {
+        _model[i].add_instance(m);
+        _touch(i, TOUCHED);
+    }
+    
+    // slots, free ones included (they hold empty models)
     size_t number_of_models()
     { return _model.size(); }
     
+    // the caller may move the model or its meshes, so it is checked for
+    // changes on the next frame
     Model& model(unsigned int i)
     {
+        _touch(i, TOUCHED);
         return _model[i];
     }
 
+    // replace model i by model, which keeps its place in the spatial index
+    // (assigning to model(i) would go unnoticed if the versions match)
+    void set_model(unsigned int i, const Model& model)
+    {
+        _model[i] = model;
+        _touch(i, REPLACED);
+    }
+
+    // Spatial queries, answered by the bounding volume hierarchy over all
+    // models and instances
+
+    // items whose bounds intersect the frustum
+    void query(const Frustum& frustum, std::vector<SceneItem>& result)
+    {
+        _update_bvh();
+        _query.clear();
+        _bvh.query(frustum, _query);
+        for (size_t i = 0; i < _query.size(); ++i)
+            result.push_back(_items[_query[i]]);
+    }
+
+    // items whose bounds overlap box
+    void query(const AABB& box, std::vector<SceneItem>& result)
+    {
+        _update_bvh();
+        _query.clear();
+        _bvh.query(box, _query);
+        for (size_t i = 0; i < _query.size(); ++i)
+            result.push_back(_items[_query[i]]);
+    }
+
+    // closest item whose bounds are hit by the ray origin + t*direction
+    bool pick(glm::vec3 origin, glm::vec3 direction, SceneItem& item, float& distance)
+    {
+        _update_bvh();
+        uint32_t hit;
+        if (!_bvh.raycast(origin, direction, FLT_MAX, hit, distance))
+            return false;
+        item = _items[hit];
+        return true;
+    }
+
 
 private:
+    // how a model changed since the BVH last saw it
+    enum Touch { UNTOUCHED = 0, TOUCHED, REPLACED };
+
+    void _touch(unsigned int i, uint8_t how)
+    {
+        if (_touched_as.size() <= i)
+            _touched_as.resize(_model.size(), UNTOUCHED);
+        if (_touched_as[i] == UNTOUCHED)
+            _touched.push_back(i);
+        _touched_as[i] = std::max(_touched_as[i], how);
+    }
+
+    // fill the per-frame uniform block shared by every program
+    void _update_frame_uniforms()
+    {
+        FrameUniforms frame;
+        frame.view            = _view.get_matrix();
+        frame.projection      = _projection.get_matrix();
+        frame.view_projection = frame.projection * frame.view;
+        frame.camera_position = glm::vec4(_view.get_position(), 1.0f);
+        frame.set_light(_light);
+
+        _frame_buffer.update(&frame, sizeof(FrameUniforms));
+    }
+
+    // keep the BVH in sync with the models: rebuilt when models or
+    // instances were added or removed, refitted when they only moved. Only
+    // the models touched since the last call are looked at, and only those
+    // whose versions changed are refitted
+    void _update_bvh()
+    {
+        bool rebuild = _bvh_dirty;
+        for (size_t k = 0; k < _touched.size() && !rebuild; ++k) {
+            uint32_t i = _touched[k];
+            rebuild = _model[i].number_of_instances() != _instance_count[i];
+        }
+
+        if (rebuild) {
+            for (size_t k = 0; k < _touched.size(); ++k)
+                _touched_as[_touched[k]] = UNTOUCHED;
+            _touched.clear();
+
+            _items.clear();
+            _first_item.resize(_model.size());
+            _revision.resize(_model.size());
+            _mesh_version.resize(_model.size());
+            _instance_count.resize(_model.size());
+            _model_visible.resize(_model.size());
+            _instance_visible.resize(_model.size());
+
+            std::vector<AABB> boxes;
+            for (size_t i = 0; i < _model.size(); ++i) {
+                Model& m = _model[i];
+                _first_item[i]     = _items.size();
+                _revision[i]       = m.revision();
+                _mesh_version[i]   = m.mesh_version();
+                _instance_count[i] = m.number_of_instances();
+
+                if (m.number_of_instances() > 0) {
+                    m.update_instance_bounds();
+                    for (size_t j = 0; j < m.number_of_instances(); ++j) {
+                        SceneItem item = { (unsigned int)i, (int)j };
+                        _items.push_back(item);
+                        boxes.push_back(m.instance_bounds(j));
+                    }
+                } else {
+                    SceneItem item = { (unsigned int)i, -1 };
+                    _items.push_back(item);
+                    boxes.push_back(m.world_bounds());
+                }
+            }
+            _bvh.build(boxes);
+            _bvh_dirty = false;
+            return;
+        }
+
+        bool moved = false;
+        for (size_t k = 0; k < _touched.size(); ++k) {
+            uint32_t i = _touched[k];
+            Model& m = _model[i];
+            uint32_t first = _first_item[i];
+            bool replaced = _touched_as[i] == REPLACED;
+            _touched_as[i] = UNTOUCHED;
+
+            // meshes can move without the model knowing (animation)
+            unsigned int mesh_version = m.mesh_version();
+            if (!replaced && m.revision() == _revision[i] && mesh_version == _mesh_version[i])
+                continue;
+            _revision[i]     = m.revision();
+            _mesh_version[i] = mesh_version;
+
+            if (m.number_of_instances() > 0) {
+                m.update_instance_bounds();
+                for (size_t j = 0; j < m.number_of_instances(); ++j)
+                    _bvh.set_bounds(first + j, m.instance_bounds(j));
+            } else {
+                _bvh.set_bounds(first, m.world_bounds());
+            }
+            moved = true;
+        }
+        _touched.clear();
+        if (moved)
+            _bvh.refit();
+    }
+
+    // drop the items of _visible hidden behind the closest occluders
+    void _cull_occluded(const glm::mat4& view_projection)
+    {
+        glm::vec3 eye = _view.get_position();
+
+        _occluders.clear();
+        for (size_t i = 0; i < _visible.size(); ++i) {
+            if (_model[_items[_visible[i]].model].is_occluder())
+                _occluders.push_back(_visible[i]);
+        }
+        if (_occluders.size() > MAX_OCCLUDERS) {
+            BVH& bvh = _bvh;
+            std::nth_element(_occluders.begin(), _occluders.begin() + MAX_OCCLUDERS, _occluders.end(),
+                [&bvh, &eye](uint32_t a, uint32_t b) {
+                    glm::vec3 da = bvh.bounds(a).center() - eye;
+                    glm::vec3 db = bvh.bounds(b).center() - eye;
+                    return glm::dot(da, da) < glm::dot(db, db);
+                });
+            _occluders.resize(MAX_OCCLUDERS);
+        }
+
+        _occlusion.begin(view_projection, eye);
+        for (size_t i = 0; i < _occluders.size(); ++i) {
+            const SceneItem& item = _items[_occluders[i]];
+            if (item.instance < 0)
+                _occlusion.add_occluder(_model[item.model].occluder_bounds());
+            else
+                _occlusion.add_occluder(_bvh.bounds(_occluders[i]));
+        }
+        _occlusion.finish();
+
+        size_t n = 0;
+        for (size_t i = 0; i < _visible.size(); ++i) {
+            if (_occlusion.visible(_bvh.bounds(_visible[i])))
+                _visible[n++] = _visible[i];
+        }
+        _visible.resize(n);
+    }
+
     GLuint             _width, _height;
     Projection         _projection;
     View               _view;
     Light              _light;
     Shader             _shader;
     std::vector<Model> _model;
+    std::vector<unsigned int> _free; // slots of removed models
+    RenderQueue        _queue;
+
+    // spatial index over models and instances
+    BVH                                _bvh;
+    bool                               _bvh_dirty;
+    std::vector<SceneItem>             _items;
+    std::vector<uint32_t>              _first_item;       // per model
+    std::vector<unsigned int>          _revision;         // per model
+    std::vector<unsigned int>          _mesh_version;     // per model
+    std::vector<uint32_t>              _touched;          // models to check
+    std::vector<uint8_t>               _touched_as;       // per model, a Touch
+    std::vector<size_t>                _instance_count;   // per model
+    std::vector<uint32_t>              _visible;
+    std::vector<uint32_t>              _query;
+    std::vector<uint8_t>               _model_visible;    // per model
+    std::vector<std::vector<uint8_t> > _instance_visible; // per model
+
+    // occlusion culling
+    OcclusionCuller                    _occlusion;
+    bool                               _occlusion_culling;
+    std::vector<uint32_t>              _occluders;
+
+    // per-frame uniform block
+    UniformBuffer      _frame_buffer;
+    bool               _frame_dirty;
 };
 #endif // SCENE_H
 
@@ -5,24 +5,52 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include <UniformBuffer.h>
+
 class Shader {
 public:
+    // Uniforms set by the renderer, resolved once after linking
+    enum Uniform {
+        UNIFORM_SAMPLER = 0,
+        NUMBER_OF_UNIFORMS
+    };
+
     // Constructors
     Shader()
-    { }
+    {
+        _id = 0;
+        for (int i = 0; i < NUMBER_OF_UNIFORMS; ++i)
+            _location[i] = -1;
+    }
     
     // constructor generates the shader on the fly
     Shader(const char* vertexPath, const char* fragmentPath)
     {    
         _id = create_program(vertexPath, fragmentPath);
+        _reflect_uniforms();
+        _bind_uniform_blocks();
     }
     
     // Access
     GLuint id() { return _id; }
+
+    // location of a well-known uniform (-1 if the program does not use it)
+    GLint location(Uniform u)
+    { return _location[u]; }
+
+    // location of any active uniform, looked up in the table built after
+    // linking instead of querying the driver (-1 if not active)
+    GLint location(const std::string& name)
+    {
+        std::unordered_map<std::string, GLint>::const_iterator it = _uniforms.find(name);
+        return it != _uniforms.end() ? it->second : -1;
+    }
     
     // Read a shader source from a file
     // store the shader source in a std::vector<char>
@@ -110,6 +138,52 @@ public:
 
 
 private:
+    // query every active uniform of the linked program once
+    void _reflect_uniforms()
+    {
+        GLint count = 0, max_length = 0;
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+        std::vector<char> name(max_length + 1);
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint   size = 0;
+            GLenum  type = 0;
+            glGetActiveUniform(_id, i, name.size(), &length, &size, &type, &name[0]);
+
+            std::string uniform(&name[0], length);
+            GLint loc = glGetUniformLocation(_id, uniform.c_str());
+            _uniforms[uniform] = loc;
+
+            // arrays are reported as "name[0]"; also accept plain "name"
+            if (length > 3 && uniform.compare(length - 3, 3, "[0]") == 0)
+                _uniforms[uniform.substr(0, length - 3)] = loc;
+        }
+
+        static const char* names[NUMBER_OF_UNIFORMS] = {
+            "fSampler"
+        };
+        for (int i = 0; i < NUMBER_OF_UNIFORMS; ++i)
+            _location[i] = location(names[i]);
+    }
+
+    // attach the shared uniform blocks to their fixed binding points
+    void _bind_uniform_blocks()
+    {
+        GLuint frame = glGetUniformBlockIndex(_id, "Frame");
+        if (frame != GL_INVALID_INDEX)
+            glUniformBlockBinding(_id, frame, FRAME_BLOCK_BINDING);
+
+        GLuint materials = glGetUniformBlockIndex(_id, "Materials");
+        if (materials != GL_INVALID_INDEX)
+            glUniformBlockBinding(_id, materials, MATERIAL_BLOCK_BINDING);
+    }
+
     GLuint _id;
+
+    // uniform locations
+    GLint                                  _location[NUMBER_OF_UNIFORMS];
+    std::unordered_map<std::string, GLint> _uniforms;
 };
 #endif
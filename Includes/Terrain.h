@@ -0,0 +1,319 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <FastNoiseLite.h>
+#include <ThreadPool.h>
+
+#define WATER 1
+#define BEACH 2
+#define FOREST 3
+#define JUNGLE 4
+#define SAVANNAH 5
+#define DESERT 6
+#define SNOW 7
+#define NUMBER_OF_BIOMES 7
+
+// elevation, in [0, 1], at which each biome after WATER starts
+static const double biome_thresholds[NUMBER_OF_BIOMES - 1] = { 0.1, 0.2, 0.3, 0.5, 0.7, 0.9 };
+
+// side of the square tiles a heightmap is split into for generation
+#define TERRAIN_TILE 64
+
+// heightmap noise: layers of TERRAIN_NOISE, each at twice the frequency of
+// the previous one. Fixed at compile time, so the tile kernel has no
+// dispatch in it; seed, frequency and layer weights are TerrainParameters
+#define TERRAIN_NOISE FastNoiseLite::NoiseType_OpenSimplex2
+#define TERRAIN_OCTAVES 3
+#define TERRAIN_SEED 1337
+#define TERRAIN_FREQUENCY 0.01f
+
+// cells [x0, x1) x [z0, z1) of the world
+struct CellRect {
+    int x0, z0, x1, z1;
+
+    bool overlaps(const CellRect& r) const
+    { return x0 < r.x1 && r.x0 < x1 && z0 < r.z1 && r.z0 < z1; }
+};
+
+// part of the world edited by hand: its heights are raised (or lowered)
+// and, unless biome is 0, all of it is that biome
+struct TerrainRegion {
+    CellRect  cells;
+    float     height;
+    uint8_t   biome;
+};
+
+// What a Terrain is generated from. Global parameters change the whole
+// terrain and bump revision(); regions only change their own cells, which
+// are remembered until take_dirty() so that only the chunks under them are
+// rebuilt. Copying the parameters is cheap, so jobs work on snapshots.
+class TerrainParameters {
+public:
+    TerrainParameters()
+        : _seed(TERRAIN_SEED), _frequency(TERRAIN_FREQUENCY), _revision(0)
+    {
+        // each layer half the weight of the previous one
+        for (int o = 0; o < TERRAIN_OCTAVES; o++)
+            _weight[o] = 1.0 / (1 << o);
+    }
+
+    int seed() const { return _seed; }
+    float frequency() const { return _frequency; }
+    double weight(int octave) const { return _weight[octave]; }
+
+    void set_seed(int seed)
+    { if (seed != _seed) { _seed = seed; ++_revision; } }
+
+    void set_frequency(float frequency)
+    { if (frequency != _frequency) { _frequency = frequency; ++_revision; } }
+
+    void set_weight(int octave, double weight)
+    { if (weight != _weight[octave]) { _weight[octave] = weight; ++_revision; } }
+
+    // bumped whenever a global parameter changes
+    unsigned int revision() const
+    { return _revision; }
+
+    size_t number_of_regions() const
+    { return _regions.size(); }
+
+    const TerrainRegion& region(size_t i) const
+    { return _regions[i]; }
+
+    size_t add_region(const TerrainRegion& r)
+    {
+        _regions.push_back(r);
+        _dirty.push_back(r.cells);
+        return _regions.size() - 1;
+    }
+
+    void set_region(size_t i, const TerrainRegion& r)
+    {
+        _dirty.push_back(_regions[i].cells);
+        _dirty.push_back(r.cells);
+        _regions[i] = r;
+    }
+
+    void remove_region(size_t i)
+    {
+        _dirty.push_back(_regions[i].cells);
+        _regions.erase(_regions.begin() + i);
+    }
+
+    // whether some region covers a cell of rect
+    bool has_regions(const CellRect& rect) const
+    {
+        for (size_t i = 0; i < _regions.size(); i++) {
+            if (_regions[i].cells.overlaps(rect))
+                return true;
+        }
+        return false;
+    }
+
+    // moves the cells changed by region edits since the last call to dirty
+    void take_dirty(std::vector<CellRect>& dirty)
+    {
+        dirty.insert(dirty.end(), _dirty.begin(), _dirty.end());
+        _dirty.clear();
+    }
+
+private:
+    int                         _seed;
+    float                       _frequency;
+    double                      _weight[TERRAIN_OCTAVES];
+    unsigned int                _revision;
+    std::vector<TerrainRegion>  _regions;
+    std::vector<CellRect>       _dirty;
+};
+
+class Terrain
+{
+public:
+  Terrain(const TerrainParameters& parameters = TerrainParameters())
+    : _parameters(parameters)
+  { }
+
+  // heightmap of x_dim * y_dim cells, row by row, starting at cell
+  // (x_offset, y_offset) of the world; tiles are generated in parallel,
+  // each cell exactly as the serial loop would. If biomeData is not NULL it
+  // receives the x_dim * y_dim biome ids too, classified while the heights
+  // are still in cache. If normalData is not NULL it receives the unit
+  // normal (x, y, z) of the smooth surface through the heights at each
+  // cell, from the analytic noise gradient of the same pass (region edges
+  // are not part of it)
+  float* generate(int x_dim, int y_dim, int x_offset = 0, int y_offset = 0,
+                  uint8_t * biomeData = NULL, float * normalData = NULL)
+  {
+    FastNoiseLite noise;
+    noise.SetSeed(_parameters.seed());
+    noise.SetFrequency(_parameters.frequency());
+    noise.SetNoiseType(TERRAIN_NOISE);
+
+    float * noiseData = new float[x_dim * y_dim];
+
+    int x_tiles = (x_dim + TERRAIN_TILE - 1) / TERRAIN_TILE;
+    int y_tiles = (y_dim + TERRAIN_TILE - 1) / TERRAIN_TILE;
+
+    ThreadPool::instance().parallel_for(x_tiles * y_tiles, [&](size_t tile) {
+      int x0 = (tile % x_tiles) * TERRAIN_TILE;
+      int y0 = (tile / x_tiles) * TERRAIN_TILE;
+      _generate_tile<TERRAIN_NOISE, TERRAIN_OCTAVES>(noise, _parameters, noiseData, biomeData, normalData, x_dim,
+                     x_offset, y_offset, x0, y0, std::min(x0 + TERRAIN_TILE, x_dim), std::min(y0 + TERRAIN_TILE, y_dim));
+    });
+
+    _apply_regions(noiseData, biomeData, x_dim, y_dim, x_offset, y_offset);
+    return noiseData;
+  }
+
+  // biome ids of a heightmap made by generate()
+  uint8_t * getBiome(const float * noiseData, int x_dim, int y_dim) {
+    uint8_t * biomeData = new uint8_t[(size_t)x_dim * y_dim];
+    _classify(noiseData, biomeData, (size_t)x_dim * y_dim);
+    return biomeData;
+  }
+
+  const TerrainParameters& parameters() const
+  { return _parameters; }
+
+private:
+  // the hand edited regions over the heightmap
+  void _apply_regions(float * noiseData, uint8_t * biomeData, int x_dim, int y_dim, int x_offset, int y_offset)
+  {
+    CellRect map = { x_offset, y_offset, x_offset + x_dim, y_offset + y_dim };
+    if (!_parameters.has_regions(map))
+      return;
+
+    // heights first, as regions may overlap
+    CellRect c;
+    for (size_t r = 0; r < _parameters.number_of_regions(); r++) {
+      const TerrainRegion& region = _parameters.region(r);
+      if (_clip(region.cells, map, c)) {
+        for (int y = c.z0; y < c.z1; y++)
+          for (int x = c.x0; x < c.x1; x++)
+            noiseData[(size_t)y * x_dim + x] += region.height;
+      }
+    }
+    if (!biomeData)
+      return;
+
+    // then the biomes of the cells that moved, and the forced ones
+    for (size_t r = 0; r < _parameters.number_of_regions(); r++) {
+      if (_clip(_parameters.region(r).cells, map, c)) {
+        for (int y = c.z0; y < c.z1; y++)
+          _classify(noiseData + (size_t)y * x_dim + c.x0, biomeData + (size_t)y * x_dim + c.x0, c.x1 - c.x0);
+      }
+    }
+    for (size_t r = 0; r < _parameters.number_of_regions(); r++) {
+      const TerrainRegion& region = _parameters.region(r);
+      if (region.biome && _clip(region.cells, map, c)) {
+        for (int y = c.z0; y < c.z1; y++)
+          std::fill(biomeData + (size_t)y * x_dim + c.x0, biomeData + (size_t)y * x_dim + c.x1, region.biome);
+      }
+    }
+  }
+
+  // the part of cells inside map, relative to the first cell of map;
+  // false if there is none
+  static bool _clip(const CellRect& cells, const CellRect& map, CellRect& c)
+  {
+    if (!cells.overlaps(map))
+      return false;
+    c.x0 = std::max(cells.x0, map.x0) - map.x0;
+    c.z0 = std::max(cells.z0, map.z0) - map.z0;
+    c.x1 = std::min(cells.x1, map.x1) - map.x0;
+    c.z1 = std::min(cells.z1, map.z1) - map.z0;
+    return true;
+  }
+
+  // biome of every height, no branches so that the loop vectorizes: the
+  // id is WATER plus the number of thresholds the elevation reaches
+  static void _classify(const float * heights, uint8_t * biomes, size_t count)
+  {
+    for (size_t i = 0; i < count; i++) {
+      double e = (heights[i] + 6.0)/32.0;
+      int id = WATER;
+      for (int b = 0; b < NUMBER_OF_BIOMES - 1; b++)
+        id += e >= biome_thresholds[b];
+      biomes[i] = id;
+    }
+  }
+
+  // cells [x0, x1) x [y0, y1) of a heightmap x_dim cells wide whose first
+  // cell is (x_offset, y_offset) in the world, and their biomes and normals
+  // if biomeData and normalData are not NULL
+  template <FastNoiseLite::NoiseType Type, int Octaves>
+  static void _generate_tile(const FastNoiseLite& generator, const TerrainParameters& parameters,
+                             float* noiseData, uint8_t* biomeData, float* normalData, int x_dim,
+                             int x_offset, int y_offset, int x0, int y0, int x1, int y1)
+  {
+    // the noise calls are not const, so each tile works on its own copy
+    FastNoiseLite noise = generator;
+
+    // each octave of a tile row is evaluated as a batch, with its
+    // gradient when normals are wanted
+    float xs[Octaves][TERRAIN_TILE], ys[Octaves][TERRAIN_TILE], e[Octaves][TERRAIN_TILE];
+    float dx[Octaves][TERRAIN_TILE], dy[Octaves][TERRAIN_TILE];
+    int n = x1 - x0;
+
+    double total = 0;
+    for (int o = 0; o < Octaves; o++)
+      total += parameters.weight(o);
+
+    for (int y = y0; y < y1; y++) {
+      double ny = (y + y_offset)/5.0 + 0.5;
+      for (int x = x0; x < x1; x++) {
+        double nx = (x + x_offset)/5.0 + 0.5;
+        for (int o = 0; o < Octaves; o++) {
+          xs[o][x - x0] = (float)((1 << o) * nx);
+          ys[o][x - x0] = (float)((1 << o) * ny);
+        }
+      }
+      for (int o = 0; o < Octaves; o++) {
+        if (normalData)
+          noise.GetNoiseGradientSetFixed<Type>(xs[o], ys[o], e[o], dx[o], dy[o], n);
+        else
+          noise.GetNoiseSetFixed<Type>(xs[o], ys[o], e[o], n);
+      }
+
+      float * row = noiseData + (size_t)y * x_dim + x0;
+      for (int i = 0; i < n; i++) {
+        double sum = 0;
+        for (int o = 0; o < Octaves; o++)
+          sum += parameters.weight(o) * e[o][i];
+        float v = sum;
+        v = v / total;
+        row[i] = v * 32.0 - 6.0;
+      }
+      if (biomeData)
+        _classify(row, biomeData + (size_t)y * x_dim + x0, n);
+
+      // octave o is sampled at (1 << o) * (cell / 5 + 0.5), so the height
+      // changes by 32 / total * weight * (1 << o) / 5 times its gradient
+      // per cell
+      if (normalData) {
+        float * normal = normalData + ((size_t)y * x_dim + x0) * 3;
+        for (int i = 0; i < n; i++) {
+          double sx = 0, sy = 0;
+          for (int o = 0; o < Octaves; o++) {
+            sx += parameters.weight(o) * (1 << o) * dx[o][i];
+            sy += parameters.weight(o) * (1 << o) * dy[o][i];
+          }
+          double hx = sx * 32.0 / (5.0 * total), hy = sy * 32.0 / (5.0 * total);
+          double length = std::sqrt(hx * hx + 1.0 + hy * hy);
+          normal[i * 3]     = (float)(-hx / length);
+          normal[i * 3 + 1] = (float)(1.0 / length);
+          normal[i * 3 + 2] = (float)(-hy / length);
+        }
+      }
+    }
+  }
+
+  TerrainParameters _parameters;
+};
+
+#endif
@@ -0,0 +1,379 @@
+#ifndef TERRAIN_STREAMER_H
+#define TERRAIN_STREAMER_H
+
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include <Scene.h>
+#include <Terrain.h>
+#include <ThreadPool.h>
+#include <ChunkMesher.h>
+#include <ChunkCache.h>
+
+// chunks kept loaded in each direction around the player
+#define CHUNK_RADIUS 2
+// at most this many chunks stay loaded; the least recently used go first
+#define CHUNK_CACHE 49
+// finished chunks the GL thread adds to the scene each frame
+#define CHUNK_UPLOADS 2
+
+struct ChunkCoord {
+    int x, z;
+
+    bool operator==(const ChunkCoord& c) const
+    { return x == c.x && z == c.z; }
+};
+
+struct ChunkCoordHash {
+    size_t operator()(const ChunkCoord& c) const
+    { return std::hash<uint64_t>()(((uint64_t)(uint32_t)c.x << 32) | (uint32_t)c.z); }
+};
+
+// Terrain split in square chunks of CHUNK_SIZE cells, each one a model of
+// the scene. update() requests the chunks around a position; jobs on the
+// thread pool read them from the disk cache, or generate and mesh them,
+// and hand the faces back through a ready list. upload(), called once a
+// frame on the GL thread, turns a few of them into models, so the frame
+// never waits for the terrain. Once more than CHUNK_CACHE chunks are
+// loaded the least recently used are evicted. Jobs never wait for the GL
+// thread, and once the streamer stops they finish without working.
+//
+// The terrain is generated from parameters(), which can be edited live:
+// a global change rebuilds every chunk, a region edit only the chunks it
+// touches. Rebuilt chunks replace their models in place when ready. An
+// edit made while a chunk is still queued folds into its request, and a
+// job a later request supersedes stops early and drops its chunk.
+class TerrainStreamer {
+public:
+    TerrainStreamer(Scene& scene)
+        : _scene(scene)
+    { }
+
+    ~TerrainStreamer()
+    { _stop(); }
+
+    TerrainStreamer(const TerrainStreamer&) = delete;
+    TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+
+    // texture and material of the terrain blocks
+    void set_block(const char* texture_path, const Material& material)
+    { _mesher.load(texture_path, material); }
+
+    // what the terrain is generated from; changes are picked up by the
+    // next upload()
+    TerrainParameters& parameters()
+    { return _parameters; }
+
+    // chunk containing world position p
+    static ChunkCoord chunk_at(const glm::vec3& p)
+    {
+        const float size = CHUNK_SIZE * CHUNK_CELL;
+        ChunkCoord c = { (int)std::floor(p.x / size), (int)std::floor(p.z / size) };
+        return c;
+    }
+
+    // request the chunks within CHUNK_RADIUS of position p; returns at once
+    void update(const glm::vec3& p)
+    {
+        ChunkCoord center = chunk_at(p);
+        if (_loaded && center == _center)
+            return;
+        _center = center;
+        _loaded = true;
+
+        // mark the chunks in range as most recently used, requesting the
+        // ones neither loaded nor on their way
+        for (int z = center.z - CHUNK_RADIUS; z <= center.z + CHUNK_RADIUS; ++z) {
+            for (int x = center.x - CHUNK_RADIUS; x <= center.x + CHUNK_RADIUS; ++x) {
+                ChunkCoord c = { x, z };
+                auto it = _chunks.find(c);
+                if (it != _chunks.end())
+                    _lru.splice(_lru.begin(), _lru, it->second.lru);
+                else if (_pending.find(c) == _pending.end())
+                    _request(c);
+            }
+        }
+    }
+
+    // rebuilds the chunks changed parameters affect and adds at most
+    // CHUNK_UPLOADS finished chunks to the scene; call once a frame from
+    // the GL thread
+    void upload()
+    {
+        _track_parameters();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _arrived.insert(_arrived.end(), _ready.begin(), _ready.end());
+            _ready.clear();
+        }
+
+        int uploads = 0;
+        while (uploads < CHUNK_UPLOADS && !_arrived.empty()) {
+            ChunkJob* job = _arrived.front();
+            _arrived.pop_front();
+            ChunkCoord c = job->request->coord;
+
+            // a later request for the same chunk supersedes this one; it
+            // costs no upload
+            auto pending = _pending.find(c);
+            if (pending == _pending.end() || pending->second != job->request) {
+                delete job;
+                continue;
+            }
+            _pending.erase(pending);
+            ++uploads;
+
+            auto it = _chunks.find(c);
+            if (it != _chunks.end())
+                _scene.set_model(it->second.model, _mesher.model(job->geometry));
+            // the player may have moved on while it was built
+            else if (std::abs(c.x - _center.x) <= CHUNK_RADIUS && std::abs(c.z - _center.z) <= CHUNK_RADIUS)
+                _add_chunk(c, job->geometry);
+            delete job;
+        }
+
+        while (_chunks.size() > CHUNK_CACHE)
+            _evict(_lru.back());
+    }
+
+    // stop the jobs, forget the chunks, whose models the scene releases,
+    // and delete the block textures; call before the GL context is
+    // destroyed
+    void release()
+    {
+        _stop();
+        _chunks.clear();
+        _lru.clear();
+        _mesher.release();
+    }
+
+    size_t number_of_chunks()
+    { return _chunks.size(); }
+
+    // chunks requested but not added yet
+    size_t number_of_pending_chunks()
+    { return _pending.size(); }
+
+private:
+    struct Chunk {
+        unsigned int                     model; // slot in the scene
+        std::list<ChunkCoord>::iterator  lru;
+    };
+
+    // the last request for a chunk, shared with the job building it. Until
+    // the job starts a new request only updates its parameters; after, the
+    // new request cancels it
+    struct ChunkRequest {
+        ChunkCoord         coord;
+        TerrainParameters  parameters;        // guarded by _mutex
+        bool               started = false;   // guarded by _mutex
+        std::atomic<bool>  cancelled{false};
+    };
+
+    // a chunk on its way from a worker
+    struct ChunkJob {
+        ChunkGeometry                  geometry;
+        std::shared_ptr<ChunkRequest>  request;
+    };
+
+    // makes the jobs still queued return at once, waits for the running
+    // ones and drops what they built
+    void _stop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stopping = true;
+        _idle.wait(lock, [this] { return _in_flight == 0; });
+
+        for (size_t i = 0; i < _ready.size(); ++i)
+            delete _ready[i];
+        _ready.clear();
+        for (size_t i = 0; i < _arrived.size(); ++i)
+            delete _arrived[i];
+        _arrived.clear();
+        _pending.clear();
+    }
+
+    // requests again the chunks, loaded or on their way, that parameter
+    // changes since the last call affect: all of them for a global change,
+    // those under the edited regions otherwise
+    void _track_parameters()
+    {
+        bool all = _parameters.revision() != _revision;
+        _revision = _parameters.revision();
+        _dirty.clear();
+        _parameters.take_dirty(_dirty);
+        if (!all && _dirty.empty())
+            return;
+
+        _stale.clear();
+        for (auto& chunk : _chunks) {
+            if (all || _touches(chunk.first))
+                _stale.push_back(chunk.first);
+        }
+        for (auto& pending : _pending) {
+            if (_chunks.find(pending.first) == _chunks.end() && (all || _touches(pending.first)))
+                _stale.push_back(pending.first);
+        }
+        for (size_t i = 0; i < _stale.size(); ++i)
+            _request(_stale[i]);
+    }
+
+    // cells chunk c is generated from, its border included
+    static CellRect _cells(const ChunkCoord& c)
+    {
+        CellRect r = { c.x * CHUNK_SIZE - 1, c.z * CHUNK_SIZE - 1,
+                       (c.x + 1) * CHUNK_SIZE + 1, (c.z + 1) * CHUNK_SIZE + 1 };
+        return r;
+    }
+
+    // whether a dirty rectangle covers a cell of chunk c
+    bool _touches(const ChunkCoord& c)
+    {
+        CellRect cells = _cells(c);
+        for (size_t i = 0; i < _dirty.size(); ++i) {
+            if (_dirty[i].overlaps(cells))
+                return true;
+        }
+        return false;
+    }
+
+    // reads chunk c from the disk cache on a worker, or generates and
+    // meshes it there, with a border of one cell for the mesher, and
+    // caches it for the next run. Chunks under a region are not cached.
+    // A chunk already queued is not queued again: its job builds from the
+    // parameters of the last request
+    void _request(const ChunkCoord& c)
+    {
+        if (_stopping)
+            return;
+
+        std::shared_ptr<ChunkRequest>& pending = _pending[c];
+        if (pending) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!pending->started) {
+                pending->parameters = _parameters;
+                return;
+            }
+            pending->cancelled = true;
+        }
+
+        std::shared_ptr<ChunkRequest> request = std::make_shared<ChunkRequest>();
+        request->coord = c;
+        request->parameters = _parameters;
+        pending = request;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_in_flight;
+        }
+        ThreadPool::instance().run([this, request] { _build(request); });
+    }
+
+    // the job of a request. It works on a copy of the parameters, so they
+    // can be edited while it runs, and gives up as soon as a later request
+    // cancels it
+    void _build(const std::shared_ptr<ChunkRequest>& request)
+    {
+        TerrainParameters parameters;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            request->started = true;
+            parameters = request->parameters;
+        }
+        if (_stopping || request->cancelled) {
+            _finish(NULL);
+            return;
+        }
+
+        ChunkCoord c = request->coord;
+        ChunkJob* job = new ChunkJob;
+        job->request = request;
+
+        uint64_t key = ChunkCache::key(parameters);
+        bool cached = !parameters.has_regions(_cells(c));
+        if (!cached || !_cache.load(key, c.x, c.z, job->geometry)) {
+            Terrain terrain(parameters);
+            uint8_t biomes[ChunkCache::CELLS];
+            float* heights = terrain.generate(CHUNK_SIZE + 2, CHUNK_SIZE + 2,
+                                              c.x * CHUNK_SIZE - 1, c.z * CHUNK_SIZE - 1, biomes);
+            job->geometry.x = c.x;
+            job->geometry.z = c.z;
+            ChunkMesher::mesh(heights, c.x * CHUNK_SIZE, c.z * CHUNK_SIZE, job->geometry);
+            if (cached && !request->cancelled)
+                _cache.store(key, c.x, c.z, heights, biomes, job->geometry);
+            delete[] heights;
+        }
+
+        if (request->cancelled) {
+            delete job;
+            job = NULL;
+        }
+        _finish(job);
+    }
+
+    // hands the chunk a job built (if any) to the GL thread
+    void _finish(ChunkJob* job)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (job)
+            _ready.push_back(job);
+        if (--_in_flight == 0)
+            _idle.notify_all();
+    }
+
+    void _add_chunk(const ChunkCoord& c, ChunkGeometry& g)
+    {
+        _lru.push_front(c);
+        Chunk chunk = { _scene.add_model(_mesher.model(g)), _lru.begin() };
+        _chunks[c] = chunk;
+    }
+
+    // the slot of the chunk goes to the next chunk added
+    void _evict(ChunkCoord c)
+    {
+        auto it = _chunks.find(c);
+        _scene.remove_model(it->second.model);
+        _lru.erase(it->second.lru);
+        _chunks.erase(it);
+    }
+
+    Scene&                                                 _scene;
+    ChunkMesher                                            _mesher;
+    ChunkCache                                             _cache;
+    std::unordered_map<ChunkCoord, Chunk, ChunkCoordHash>  _chunks;
+    std::list<ChunkCoord>                                  _lru;     // most recently used first
+    ChunkCoord                                             _center = { 0, 0 };
+    bool                                                   _loaded = false;
+
+    // requested chunks not uploaded yet, by their last request; only the
+    // GL thread touches them
+    std::unordered_map<ChunkCoord, std::shared_ptr<ChunkRequest>, ChunkCoordHash>  _pending;
+    std::deque<ChunkJob*>                                  _arrived;
+
+    // chunks handed back by the jobs, and the jobs not finished yet
+    std::mutex                                             _mutex;
+    std::condition_variable                                _idle;
+    std::vector<ChunkJob*>                                 _ready;
+    int                                                    _in_flight = 0;
+    std::atomic<bool>                                      _stopping{false};
+
+    // parameter tracking
+    TerrainParameters                                      _parameters;
+    unsigned int                                           _revision = 0;
+    std::vector<CellRect>                                  _dirty;
+    std::vector<ChunkCoord>                                _stale;
+};
+
+#endif
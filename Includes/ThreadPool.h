@@ -0,0 +1,128 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+// Fixed set of worker threads running queued jobs. parallel_for splits a
+// range of work items among the workers and the calling thread and returns
+// when all of them are done.
+class ThreadPool {
+public:
+    // the pool shared by the whole program, one worker per extra core
+    static ThreadPool& instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    explicit ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0) {
+            unsigned cores = std::thread::hardware_concurrency();
+            threads = cores > 1 ? cores - 1 : 1;
+        }
+
+        for (unsigned i = 0; i < threads; ++i)
+            _workers.emplace_back([this] { _work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (size_t i = 0; i < _workers.size(); ++i)
+            _workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t number_of_threads()
+    { return _workers.size(); }
+
+    // queues job to run on some worker
+    void run(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+        }
+        _wake.notify_one();
+    }
+
+    // calls fn(i) for every i in [0, count); items are taken in order by
+    // whichever thread is free, the caller included. Safe to call from a
+    // job: the caller never waits on helpers that have not started
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        // helpers may start after the caller has returned, so what they
+        // share lives on the heap; fn is only touched for a claimed item,
+        // and the caller waits for those
+        struct Range {
+            std::atomic<size_t>      next{0};
+            size_t                   done = 0;
+            std::mutex               mutex;
+            std::condition_variable  finished;
+        };
+        std::shared_ptr<Range> range = std::make_shared<Range>();
+        const std::function<void(size_t)>* body = &fn;
+
+        auto drain = [range, body, count] {
+            size_t n = 0;
+            for (size_t i = range->next++; i < count; i = range->next++, ++n)
+                (*body)(i);
+            if (n == 0)
+                return;
+            std::lock_guard<std::mutex> lock(range->mutex);
+            if ((range->done += n) == count)
+                range->finished.notify_one();
+        };
+
+        size_t helpers = std::min(_workers.size(), count - 1);
+        for (size_t i = 0; i < helpers; ++i)
+            run(drain);
+        drain();
+
+        std::unique_lock<std::mutex> lock(range->mutex);
+        range->finished.wait(lock, [&] { return range->done == count; });
+    }
+
+private:
+    void _work()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+                if (_stop && _jobs.empty())
+                    return;
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread>            _workers;
+    std::deque<std::function<void()> >  _jobs;
+    std::mutex                          _mutex;
+    std::condition_variable             _wake;
+    bool                                _stop = false;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <glm/glm.hpp>
+
+// Node of the transform hierarchy (Model -> Mesh). A node keeps its local
+// matrix and caches its world matrix, which is only recomputed when the
+// local matrix or the parent's world matrix changed since the last query.
+//
+// Parents are passed explicitly to world() instead of being stored, so
+// nodes stay valid when models are copied or moved around in a vector.
+class Transform {
+public:
+    Transform()
+        : _local(1.0f), _world(1.0f), _normal(1.0f),
+          _dirty(true), _version(0), _local_version(0), _parent_version(0)
+    { }
+
+    void set_local(const glm::mat4& m)
+    {
+        _local = m;
+        _dirty = true;
+        _local_version++;
+    }
+
+    const glm::mat4& local() const
+    { return _local; }
+
+    // force the world matrix to be recomputed on the next query (needed
+    // when the node is queried with a different parent)
+    void invalidate()
+    { _dirty = true; }
+
+    // world matrix of a root node
+    const glm::mat4& world()
+    {
+        if (_dirty)
+            _update(_local);
+        return _world;
+    }
+
+    // world matrix of a child of parent
+    const glm::mat4& world(Transform& parent)
+    {
+        const glm::mat4& p = parent.world();
+        if (_dirty || parent._version != _parent_version) {
+            _parent_version = parent._version;
+            _update(p * _local);
+        }
+        return _world;
+    }
+
+    // normal matrix of the world matrix returned by the last world() call
+    const glm::mat3& normal() const
+    { return _normal; }
+
+    // bumped whenever the world matrix is recomputed
+    unsigned int version() const
+    { return _version; }
+
+    // bumped whenever the local matrix is set
+    unsigned int local_version() const
+    { return _local_version; }
+
+private:
+    void _update(const glm::mat4& world)
+    {
+        _world  = world;
+        _normal = glm::transpose(glm::inverse(glm::mat3(world)));
+        _dirty  = false;
+        _version++;
+    }
+
+    glm::mat4    _local;
+    glm::mat4    _world;
+    glm::mat3    _normal;
+    bool         _dirty;
+    unsigned int _version;
+    unsigned int _local_version;
+    unsigned int _parent_version; // parent version _world was computed from
+};
+#endif // TRANSFORM_H
@@ -0,0 +1,67 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <GL/glew.h>
+
+// Fixed binding points of the uniform blocks shared by every program
+enum UniformBlockBinding {
+    FRAME_BLOCK_BINDING    = 0,
+    MATERIAL_BLOCK_BINDING = 1,
+};
+
+// Uniform buffer object bound to a fixed binding point. The GL buffer is
+// created on first update, so it can live in objects constructed before
+// the GL context exists.
+class UniformBuffer {
+public:
+    UniformBuffer(GLuint binding = 0)
+        : _id(0), _size(0), _binding(binding)
+    { }
+
+    ~UniformBuffer()
+    { release(); }
+
+    // one GL buffer, one owner
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    GLuint id() { return _id; }
+
+    // write size bytes to the buffer (reallocating it if it grows) and
+    // attach it to its binding point
+    void update(const void* data, GLsizeiptr size)
+    {
+        if (_id == 0)
+            glGenBuffers(1, &_id);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, _id);
+        if (size > _size) {
+            glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+            _size = size;
+        } else {
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        bind();
+    }
+
+    void bind()
+    { glBindBufferBase(GL_UNIFORM_BUFFER, _binding, _id); }
+
+    // delete the GL buffer while the context is still there; the next
+    // update creates it again
+    void release()
+    {
+        if (_id != 0)
+            glDeleteBuffers(1, &_id);
+        _id = 0;
+        _size = 0;
+    }
+
+private:
+    GLuint     _id;
+    GLsizeiptr _size;
+    GLuint     _binding;
+};
+#endif // UNIFORM_BUFFER_H
@@ -0,0 +1,20 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texture coordinates
+    glm::vec2 TextureCoords;
+};
+
+// triangular face
+struct Face {
+    glm::uvec3 Index;
+};
+
+#endif // VERTEX_H
@@ -17,19 +17,18 @@
 #include <Mesh.h>
 #include <Shader.h>
 #include <Scene.h>
-#include <FastNoiseLite.h>
+#include <TerrainStreamer.h>
+#include <HeightfieldTerrain.h>
+
+// terrain as meshed chunks streamed around steve (0), or as one heightmap
+// texture displacing an instanced grid of blocks (1), HEIGHTFIELD_SIZE
+// cells on a side
+#define HEIGHTFIELD_TERRAIN 0
+#define HEIGHTFIELD_SIZE 64
 
 #define UP_DIRECTION 100
 #define DOWN_DIRECTION 010
 
-#define WATER 1
-#define BEACH 2
-#define FOREST 3
-#define JUNGLE 4
-#define SAVANNAH 5
-#define DESERT 6
-#define SNOW 7
-
 std::string program_name;
 GLsizei width, height; // window size
 
@@ -57,55 +56,18 @@ glm::vec3 up(0.0,1.0,0.0);
 
 //glm::mat4 view;
 
-class Terrain
+class MyScene : public Scene
 {
 public:
-  float* generate(int x_dim, int y_dim)
-  {
-    FastNoiseLite noise;
-    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
-
-    float * noiseData = new float[x_dim * y_dim];
-    int index = 0;
-
-    for (int y = 0; y < y_dim; y++) {
-      for (int x = 0; x < x_dim; x++) {
-        double nx = x/5.0 + 0.5;
-        double ny = y/5.0 + 0.5;
-        //std::cout << nx << ", " << ny << std::endl;
-        float e = 1 * noise.GetNoise((float)(1 * nx), (float)(1 * ny)) +  0.5 * noise.GetNoise((float)(2 * nx), (float)(2 * ny)) + 0.25 * noise.GetNoise((float)(4 * nx), (float)(4 * ny));
-        e = e / (1.0 + 0.5 + 0.25);
-        noiseData[index++] = e * 32.0 - 6.0;
-      }
-    }
-
-    return noiseData;
-  }
+    MyScene()
+        : terrain(*this)
+    { }
 
-  int * getBiome(float * noiseData, int x_dim, int y_dim) {
-    int * biomeData = new int[x_dim * y_dim];
-    int index = 0;
-
-    for (int y = 0; y < y_dim; y++) {
-      for (int x = 0; x < x_dim; x++) {
-        float e = (noiseData[index++] + 6.0)/32.0;
-        if (e < 0.1) biomeData[index] = WATER;
-        else if (e < 0.2) biomeData[index] = BEACH;
-        else if (e < 0.3) biomeData[index] = FOREST;
-        else if (e < 0.5) biomeData[index] = JUNGLE;
-        else if (e < 0.7) biomeData[index] = SAVANNAH;
-        else if (e < 0.9) biomeData[index] = DESERT;
-        else biomeData[index] = SNOW;
-      }
-    }
+    // chunks of terrain loaded around steve
+    TerrainStreamer terrain;
+    // or the whole terrain in one heightmap texture
+    HeightfieldTerrain heightfield;
 
-    return biomeData;
-  }
-};
-
-class MyScene : public Scene
-{
-public:
     void walk()
     {
         noMove = 0;
@@ -171,6 +133,16 @@ public:
     {
       glm::mat4 matrix = glm::translate(model(0).matrix(), glm::vec3(0.25,0.0,0.0));
       model(0).set_matrix(matrix);
+      stream_terrain();
+    }
+
+    // request the terrain chunks around steve; they are added as they are
+    // ready, dropping far away ones
+    void stream_terrain()
+    {
+#if !HEIGHTFIELD_TERRAIN
+      terrain.update(glm::vec3(model(0).matrix()[3]));
+#endif
     }
 
     void move_steve_vertical(int direction)
@@ -194,28 +166,19 @@ public:
       model(0).set_matrix(matrix);
     }
     
+    // rotation axis point of a body part: center of the top of its
+    // bounding box, cached by the mesh at import
     glm::vec3 leg_top_center(int leg)
     {
-       // compute bounding box
-       GLfloat xmin(0), xmax(0), ymin(0), ymax(0), zmin(0), zmax(0);
-       
-       Mesh& mesh = model(0).mesh(leg);
-       for (size_t i = 0; i < mesh.number_of_vertices(); ++i) {
-           glm::vec3 p = mesh.vertex(i).Position;
-           
-           std::cout << glm::to_string(p) << std::endl;
-           
-           xmax = std::max(xmax, p.x);
-           xmin = std::min(xmin, p.x);
-           ymax = std::max(ymax, p.y);
-           ymin = std::min(ymin, p.y);
-           zmax = std::max(zmax, p.z);
-           zmin = std::min(zmin, p.z);
-       }
-       
-       return glm::vec3(0.5*(xmin + xmax),
-                        ymax,
-                        0.5*(zmin + zmax));
+       return model(0).mesh(leg).pivot(PIVOT_TOP_CENTER);
+    }
+
+    // GL objects of the scene and of the terrain
+    void release()
+    {
+      terrain.release();
+      heightfield.release();
+      Scene::release();
     }
 };
 
@@ -240,6 +203,10 @@ display(GLFWwindow* window);
 void
 initialize();
 
+// Release the GL objects, then terminate GLFW
+void
+finalize();
+
 static void
 error(int id, const char* description);
 
@@ -304,8 +271,8 @@ main(int argc, char *argv[])
     glfwPollEvents();
   }
   
-  // Terminate GLFW
-  glfwTerminate();
+  // Release the scene and terminate GLFW
+  finalize();
   
   return EXIT_SUCCESS;
 }
@@ -315,8 +282,12 @@ void
 display(GLFWwindow* window)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // terrain built in the background since the last frame
+    scene.terrain.upload();
   
     scene.render();
+    scene.heightfield.render();
 
     // idle movement
     noMove++;
@@ -392,38 +363,27 @@ initialize()
   glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, -4.0f, 0.0f));
   scene.model(0).set_matrix(matrix);
 
-  // terrain
+  // terrain around steve (see HEIGHTFIELD_TERRAIN); grass blocks with the
+  // material of the grass block model
+  Material grass = load_material("Data/Grass_Block.obj");
+#if HEIGHTFIELD_TERRAIN
   Terrain terrain;
-  int x_dim = 64;
-  int y_dim = 64;
-  float * noiseData = terrain.generate(x_dim, y_dim);
-  //int * biomeData = terrain.getBiome(noiseData, x_dim, y_dim);
-  int floor_model = 1;
-  int index = 0;
-
-  scene.add_model("Data/Grass_Block.obj");
-  Model copy = scene.model(floor_model);
-
-  for (int y = 0; y < y_dim; y++) {
-    for (int x = 1; x < x_dim; x++) {
-      //std::cout << "(" << x << ", " << y << ") = " << ceil(noiseData[index++]) << std::endl;
-      scene.add_model(copy);
-    }
-  }
-
-  index = 0;
+  float * normalData = new float[HEIGHTFIELD_SIZE * HEIGHTFIELD_SIZE * 3];
+  float * noiseData = terrain.generate(HEIGHTFIELD_SIZE, HEIGHTFIELD_SIZE,
+                                       -HEIGHTFIELD_SIZE / 2, -HEIGHTFIELD_SIZE / 2, NULL, normalData);
+  scene.heightfield.load("Sources/shaders/heightfield.glsl", "Sources/shaders/fragment.glsl",
+                         "Data/Grass_Block_TEX.png", grass);
+  scene.heightfield.set_heights(noiseData, HEIGHTFIELD_SIZE, HEIGHTFIELD_SIZE,
+                                -HEIGHTFIELD_SIZE / 2, -HEIGHTFIELD_SIZE / 2, normalData);
+  delete[] noiseData;
+  delete[] normalData;
+#else
+  scene.terrain.set_block("Data/Grass_Block_TEX.png", grass);
+  scene.stream_terrain();
+#endif
 
-  for (int y = 0; y < y_dim; y++) {
-    for (int x = 0; x < x_dim; x++) {
-      //std::cout << "(" << x << ", " << y << ") = " << ceil(noiseData[floor_model] * 128.0) << std::endl;
-      //(float)ceil(noiseData[floor_model] * 5.0)
-      glm::mat4 floor_matrix = glm::translate(glm::mat4(1.0f), glm::vec3((float)x*2.0, ceil(noiseData[index++])*2.0, (float)y*2.0));
-      scene.model(floor_model).set_matrix(floor_matrix);
-      floor_model++;
-    }
-  }
-  
   std::cout << "Number of models: " << scene.number_of_models() << std::endl;
+  std::cout << "Terrain chunks requested: " << scene.terrain.number_of_pending_chunks() << std::endl;
   
   // set scene light
   Light light = {
@@ -449,6 +409,18 @@ initialize()
   scene.set_shader("Sources/shaders/vertex.glsl", "Sources/shaders/fragment.glsl");
 }
 
+void
+finalize()
+{
+  // GL objects go while the context is there; the pools are released
+  // last, once no mesh uses them
+  scene.release();
+  MaterialTable::instance().release();
+  GeometryPool::instance().release();
+
+  glfwTerminate();
+}
+
 // Called when the window is resized
 void
 window_resized(GLFWwindow* window, int width, int height)
@@ -550,7 +522,7 @@ keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
   }
   if (key == GLFW_KEY_Q){
     if (action == GLFW_PRESS) {
-      glfwTerminate();
+      finalize();
       exit(0);
     }
   }
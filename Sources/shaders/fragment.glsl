@@ -4,6 +4,7 @@ in vec3 fN;
 in vec3 fL;
 in vec3 fE;
 in vec2 texCoord;
+flat in int fMaterial;
 
 struct Light {
   vec3 position;
@@ -19,16 +20,27 @@ struct Material {
   float shininess;
 };
 
-uniform mat4 model;
-uniform mat4 view;
+// per-frame state shared by every program (std140, see FrameUniforms.h)
+layout(std140) uniform Frame {
+  mat4  view;
+  mat4  projection;
+  mat4  view_projection;
+  vec4  camera_position;
+  Light light;
+};
 
-uniform Light    light;
-uniform Material material;
+// all materials in use (std140, see MaterialTable.h)
+#define MAX_MATERIALS 256
+layout(std140) uniform Materials {
+  Material materials[MAX_MATERIALS];
+};
 
 uniform sampler2D fSampler;
 
 void main()
 {   
+    Material material = materials[fMaterial];
+
     vec3 N = normalize(fN);
     vec3 L = normalize(fL);
     vec3 E = normalize(fE);
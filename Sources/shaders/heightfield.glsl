@@ -0,0 +1,56 @@
+#version 330
+
+// one block, drawn once per heightmap cell (see HeightfieldTerrain.h)
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vNormal;
+layout(location = 2) in vec2 vTexCoord;
+
+// one height per cell, in blocks, and the normal of the terrain surface
+// there, lighting the tops of the blocks if vSmooth is set
+uniform sampler2D vHeights;
+uniform sampler2D vNormals;
+uniform bool      vSmooth;
+// world cell of texel (0, 0), world size of a cell and block material
+uniform ivec2 vOrigin;
+uniform float vCell;
+uniform int   vMaterial;
+
+out vec3 fN;
+out vec3 fL;
+out vec3 fE;
+out vec2 texCoord;
+flat out int fMaterial;
+
+struct Light {
+  vec3 position;
+  vec4 ambient;
+  vec4 diffuse;
+  vec4 specular;
+};
+
+// per-frame state shared by every program (std140, see FrameUniforms.h)
+layout(std140) uniform Frame {
+  mat4  view;
+  mat4  projection;
+  mat4  view_projection;
+  vec4  camera_position;
+  Light light;
+};
+
+void main()
+{
+    ivec2 size = textureSize(vHeights, 0);
+    ivec2 cell = ivec2(gl_InstanceID % size.x, gl_InstanceID / size.x);
+    float h = ceil(texelFetch(vHeights, cell, 0).r);
+
+    vec3 position = vPosition + vec3(float(cell.x + vOrigin.x), h, float(cell.y + vOrigin.y)) * vCell;
+
+    fN = vSmooth && vNormal.y > 0.5 ? texelFetch(vNormals, cell, 0).xyz : vNormal;
+    fE = position;
+    fL = light.position;
+
+    texCoord    = vTexCoord;
+    fMaterial   = vMaterial;
+
+    gl_Position = view_projection * vec4(position, 1.0);
+}
@@ -3,11 +3,16 @@
 layout(location = 0) in vec4 vPosition;
 layout(location = 1) in vec4 vNormal;
 layout(location = 2) in vec2 vTexCoord;
+// per-draw data (see InstanceData in GeometryPool.h)
+layout(location = 3) in mat4 iModel;
+layout(location = 7) in int  iMaterial;
+layout(location = 8) in mat3 iNormalMatrix;
 
 out vec3 fN;
 out vec3 fL;
 out vec3 fE;
 out vec2 texCoord;
+flat out int fMaterial;
 
 struct Light {
   vec3 position;
@@ -16,21 +21,23 @@ struct Light {
   vec4 specular;
 };
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform Light light;
+// per-frame state shared by every program (std140, see FrameUniforms.h)
+layout(std140) uniform Frame {
+  mat4  view;
+  mat4  projection;
+  mat4  view_projection;
+  vec4  camera_position;
+  Light light;
+};
 
 void main()
 {
-    mat4 ModelView = view * model;
-
-    fN = transpose(inverse(mat3(model))) * vNormal.xyz;
+    fN = iNormalMatrix * vNormal.xyz;
     fE = vPosition.xyz;
     fL = light.position;
     
     texCoord    = vTexCoord;
+    fMaterial   = iMaterial;
     
-    gl_Position = projection * ModelView * vPosition;
+    gl_Position = view_projection * iModel * vPosition;
 }